@@ -2,366 +2,3406 @@
  * Copyright (C) 2021, HENSOLDT Cyber GmbH
  */
 
+#if defined(KeystoreRamFV_TIMING) && !defined(_POSIX_C_SOURCE)
+#   define _POSIX_C_SOURCE 199309L /* for clock_gettime() */
+#endif
+
 #include "KeystoreRamFV.h"
 
 #include "stdlib_fv.h"
 
+#if defined(KeystoreRamFV_TIMING)
+#   include <time.h>
+#endif
+
+/*
+ * The linear scan compares fingerprints 16 at a time with SSE2 and 32 at a
+ * time with AVX2. Without fingerprints it compares names with SSE2, and with
+ * AVX2 two names at once in a split store, if the names have 16 bytes.
+ * Defining KeystoreRamFV_SCAN_SCALAR forces the portable scan.
+ */
+#if !defined(KeystoreRamFV_SCAN_SCALAR) && defined(__SSE2__)
+#   define KeystoreRamFV_SCAN_SSE2
+#   include <emmintrin.h>
+#   if defined(__AVX2__)
+#       define KeystoreRamFV_SCAN_AVX2
+#       include <immintrin.h>
+#   endif
+#endif
+
+/*
+ * Built with KeystoreRamFV_STATISTICS, the operations count into the
+ * statistics of the store, see KeystoreRamFV.h. Otherwise the counting
+ * compiles to nothing.
+ */
+#if defined(KeystoreRamFV_STATISTICS)
+#   define KeystoreRamFV_COUNT(key_store, counter, n) \
+        do \
+        { \
+            if ((key_store)->statistics != NULL) \
+            { \
+                (key_store)->statistics->counter += (n); \
+            } \
+        } while (0)
+#   define KeystoreRamFV_COUNT_CALL(key_store, op, error) \
+        countCall(key_store, op, error)
+#   define KeystoreRamFV_COUNT_BATCH(key_store, op, error, results, nr_keys) \
+        countBatch(key_store, op, error, results, nr_keys)
+#else
+#   define KeystoreRamFV_COUNT(key_store, counter, n) ((void) (key_store))
+#   define KeystoreRamFV_COUNT_CALL(key_store, op, error) ((void) 0)
+#   define KeystoreRamFV_COUNT_BATCH(key_store, op, error, results, nr_keys) ((void) 0)
+#endif
+
+/*
+ * Built with KeystoreRamFV_TIMING, the public functions record their latency
+ * in the histograms of the store, see KeystoreRamFV.h. Otherwise the timing
+ * compiles to nothing.
+ */
+#if defined(KeystoreRamFV_TIMING)
+#   define KeystoreRamFV_TIME_START(timing) \
+        unsigned long timing_start = startTiming(timing)
+#   define KeystoreRamFV_TIME_STOP(timing, op) \
+        stopTiming(timing, op, timing_start)
+#else
+#   define KeystoreRamFV_TIME_START(timing)
+#   define KeystoreRamFV_TIME_STOP(timing, op) ((void) 0)
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
 
+#if defined(KeystoreRamFV_STATISTICS)
 static void
-resetElementKey(KeystoreRamFV_t *key_store, unsigned long index)
+countCall(KeystoreRamFV_t const *key_store, unsigned int op, unsigned int error)
 {
-    memset_fv(
-        key_store->elementStore[index].key.name,
-        0,
-        KeystoreRamFV_KEY_NAME_SIZE);
-    memset_fv(
-        key_store->elementStore[index].key.data,
-        0,
-        KeystoreRamFV_KEY_DATA_SIZE);
+    unsigned int error_index = 0 - error;
+
+    if (key_store->statistics == NULL)
+    {
+        return;
+    }
+
+    key_store->statistics->calls[op] += 1;
+    if (error_index < KeystoreRamFV_NR_ERRORS)
+    {
+        key_store->statistics->errors[op][error_index] += 1;
+    }
 }
 
 
+// Counts the batch as one call, and its error or else the one of each key.
 static void
-deleteElement(KeystoreRamFV_t *key_store, unsigned long index)
+countBatch(
+    KeystoreRamFV_t const *key_store,
+    unsigned int op,
+    unsigned int error,
+    KeystoreRamFV_Result_t const *results,
+    unsigned long nr_keys)
+{
+    if (key_store->statistics == NULL)
+    {
+        return;
+    }
+
+    // there are no results without the arrays
+    if (KeystoreRamFV_ERR_NONE != error)
+    {
+        countCall(key_store, op, error);
+        return;
+    }
+
+    key_store->statistics->calls[op] += 1;
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        unsigned int error_index = 0 - results[i].error;
+
+        if (error_index < KeystoreRamFV_NR_ERRORS)
+        {
+            key_store->statistics->errors[op][error_index] += 1;
+        }
+    }
+}
+#endif
+
+
+#if defined(KeystoreRamFV_TIMING)
+static unsigned long
+readClock(KeystoreRamFV_Timing_t const *timing)
+{
+    struct timespec now;
+
+    if (timing->now != NULL)
+    {
+        return timing->now();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long) now.tv_sec * 1000000000UL + (unsigned long) now.tv_nsec;
+}
+
+
+static unsigned long
+startTiming(KeystoreRamFV_Timing_t const *timing)
+{
+    return (timing != NULL) ? readClock(timing) : 0;
+}
+
+
+// Latencies below KeystoreRamFV_HISTOGRAM_SUB_BUCKETS have a bucket of their
+// own, the others are bucketed by their highest bit and the bits below it.
+static unsigned long
+histogramBucket(unsigned long latency)
+{
+    unsigned long high_bit = KeystoreRamFV_HISTOGRAM_SUB_BITS;
+
+    if (latency < KeystoreRamFV_HISTOGRAM_SUB_BUCKETS)
+    {
+        return latency;
+    }
+
+    while (high_bit + 1 < 8 * sizeof(unsigned long) && (latency >> (high_bit + 1)) != 0)
+    {
+        high_bit++;
+    }
+
+    return (high_bit - KeystoreRamFV_HISTOGRAM_SUB_BITS + 1) *
+           KeystoreRamFV_HISTOGRAM_SUB_BUCKETS +
+           ((latency >> (high_bit - KeystoreRamFV_HISTOGRAM_SUB_BITS)) &
+            (KeystoreRamFV_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+static unsigned long
+histogramBucketTop(unsigned long bucket)
+{
+    unsigned long shift;
+
+    if (bucket < KeystoreRamFV_HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    shift = bucket / KeystoreRamFV_HISTOGRAM_SUB_BUCKETS - 1;
+    return ((KeystoreRamFV_HISTOGRAM_SUB_BUCKETS +
+             bucket % KeystoreRamFV_HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+
+static void
+stopTiming(KeystoreRamFV_Timing_t *timing, unsigned int op, unsigned long start)
+{
+    if (timing == NULL)
+    {
+        return;
+    }
+
+    KeystoreRamFV_Histogram_t *histogram = &timing->histograms[op];
+    unsigned long latency = readClock(timing) - start;
+
+    histogram->count += 1;
+    histogram->buckets[histogramBucket(latency)] += 1;
+    if (latency > histogram->max)
+    {
+        histogram->max = latency;
+    }
+}
+
+
+// Returns the latency that perMille of the calls did not exceed.
+static unsigned long
+histogramPercentile(KeystoreRamFV_Histogram_t const *histogram, unsigned long perMille)
+{
+    unsigned long rank = (histogram->count * perMille + 999) / 1000;
+    unsigned long seen = 0;
+
+    for (unsigned long b = 0; b < KeystoreRamFV_HISTOGRAM_BUCKETS; b++)
+    {
+        seen += histogram->buckets[b];
+        if (seen >= rank && seen > 0)
+        {
+            return (histogramBucketTop(b) < histogram->max) ?
+                   histogramBucketTop(b) : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+#endif
+
+
+static unsigned int
+isSameName(
+    KeystoreRamFV_t const *key_store,
+    const char *name,
+    const char *other_name)
+{
+    KeystoreRamFV_COUNT(key_store, comparisons, 1);
+    return 0 == memcmp_fv(name, other_name, KeystoreRamFV_KEY_NAME_SIZE);
+}
+
+
+static void
+copyBytes(
+    KeystoreRamFV_t const *key_store,
+    void *destination,
+    void const *source,
+    unsigned long size)
+{
+    KeystoreRamFV_COUNT(key_store, bytesCopied, size);
+    memcpy_fv(destination, source, size);
+}
+
+
+static void
+zeroBytes(KeystoreRamFV_t const *key_store, void *destination, unsigned long size)
+{
+    KeystoreRamFV_COUNT(key_store, bytesZeroed, size);
+    memset_fv(destination, 0, size);
+}
+
+
+static KeystoreRamFV_ElementAdmin_t *
+elementAdmin(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return (KeystoreRamFV_ElementAdmin_t *)
+           (key_store->layout.admin + index * key_store->layout.adminStride);
+}
+
+
+static unsigned int *
+elementReadOnly(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return (unsigned int *)
+           (key_store->layout.readOnly + index * key_store->layout.readOnlyStride);
+}
+
+
+static char *
+elementName(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return key_store->layout.name + index * key_store->layout.nameStride;
+}
+
+
+static char *
+elementData(KeystoreRamFV_t const *key_store, unsigned long index)
 {
-    if (!key_store->elementStore[index].admin.isFree)
+    return key_store->layout.data + index * key_store->layout.dataStride;
+}
+
+
+static void
+setupLayout(KeystoreRamFV_t *key_store, KeystoreRamFV_Config_t const *config)
+{
+    key_store->elementStore = config->elementStore;
+
+    if (config->elementStore != NULL)
+    {
+        key_store->layout.admin = (char *) &config->elementStore[0].admin;
+        key_store->layout.readOnly = (char *) &config->elementStore[0].key.readOnly;
+        key_store->layout.name = config->elementStore[0].key.name;
+        key_store->layout.data = config->elementStore[0].key.data;
+        key_store->layout.adminStride = sizeof(KeystoreRamFV_ElementRecord_t);
+        key_store->layout.readOnlyStride = sizeof(KeystoreRamFV_ElementRecord_t);
+        key_store->layout.nameStride = sizeof(KeystoreRamFV_ElementRecord_t);
+        key_store->layout.dataStride = sizeof(KeystoreRamFV_ElementRecord_t);
+        return;
+    }
+
+    char *split_store = (char *) config->splitStore;
+    unsigned long max = config->maxElements;
+
+    key_store->layout.admin = split_store;
+    key_store->layout.readOnly = key_store->layout.admin +
+        KeystoreRamFV_SPLIT_STORE_ALIGN_UP(max * sizeof(KeystoreRamFV_ElementAdmin_t));
+    key_store->layout.name = key_store->layout.readOnly +
+        KeystoreRamFV_SPLIT_STORE_ALIGN_UP(max * sizeof(unsigned int));
+    key_store->layout.data = key_store->layout.name +
+        KeystoreRamFV_SPLIT_STORE_ALIGN_UP(max * KeystoreRamFV_KEY_NAME_SIZE);
+    key_store->layout.adminStride = sizeof(KeystoreRamFV_ElementAdmin_t);
+    key_store->layout.readOnlyStride = sizeof(unsigned int);
+    key_store->layout.nameStride = KeystoreRamFV_KEY_NAME_SIZE;
+    key_store->layout.dataStride = KeystoreRamFV_KEY_DATA_SIZE;
+}
+
+
+// An element is live if it holds a key that is visible. Occupied elements
+// that are not live hold keys of an earlier epoch, which are waiting to be
+// scrubbed after KeystoreRamFV_wipeDeferred().
+static unsigned int
+isLive(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return !elementAdmin(key_store, index)->isFree &&
+           (key_store->epoch == elementAdmin(key_store, index)->epoch ||
+            *elementReadOnly(key_store, index));
+}
+
+
+static unsigned long
+hashKey(unsigned int appId, const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    // 32 bit FNV-1a over the app id and the name
+    unsigned long hash = 2166136261UL;
+
+    hash = ((hash ^ (appId & 0xff)) * 16777619UL) & 0xffffffffUL;
+    for (unsigned long k = 0; k < KeystoreRamFV_KEY_NAME_SIZE; k++)
+    {
+        hash = ((hash ^ (unsigned char) name[k]) * 16777619UL) & 0xffffffffUL;
+    }
+
+    return hash;
+}
+
+
+// Returns the index of the key in the read only segment, maxElements if it is
+// not there.
+static unsigned long
+findSegmentKey(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    KeystoreRamFV_ReadOnlySegment_t const *segment = key_store->readOnlySegment;
+
+    if (segment == NULL || 0 == segment->nrKeys)
+    {
+        return key_store->maxElements;
+    }
+
+    unsigned long hash = hashKey(appId, name);
+    unsigned long seed = segment->seeds[hash % segment->nrBuckets];
+    unsigned long pos = segment->table[
+        KeystoreRamFV_SEGMENT_SLOT(hash, seed, segment->tableSize)];
+
+    if (pos < segment->nrKeys &&
+        appId == segment->keys[pos].appId &&
+        isSameName(key_store, name, segment->keys[pos].key.name))
+    {
+        return key_store->maxElements + 1 + pos;
+    }
+
+    return key_store->maxElements;
+}
+
+
+// The keys of the read only segment follow the elements, past maxElements,
+// which marks a key as not found.
+static unsigned long
+segmentEnd(KeystoreRamFV_t const *key_store)
+{
+    return (key_store->readOnlySegment != NULL) ?
+           key_store->maxElements + 1 + key_store->readOnlySegment->nrKeys :
+           key_store->maxElements;
+}
+
+
+static KeystoreRamFV_KeyRecord_t const *
+segmentKey(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return &key_store->readOnlySegment->keys[index - key_store->maxElements - 1].key;
+}
+
+
+static unsigned long
+keyDataSize(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    return (index < key_store->maxElements) ?
+           elementAdmin(key_store, index)->dataSize :
+           KeystoreRamFV_KEY_DATA_SIZE;
+}
+
+
+// Never 0, which marks an element without key.
+static unsigned char
+fingerprintOf(unsigned long hash)
+{
+    return (unsigned char) (0x80 | ((hash >> 25) & 0x7f));
+}
+
+
+static unsigned long
+nextIndexPos(KeystoreRamFV_t const *key_store, unsigned long pos)
+{
+    return (pos + 1 == key_store->indexSize) ? 0 : pos + 1;
+}
+
+
+// Starts an empty index. The generation of its entries is kept in the entry
+// after the table; if lazy, it is just incremented, so the entries of earlier
+// generations count as unused, otherwise all entries are cleared.
+static void
+resetIndex(KeystoreRamFV_t *key_store, unsigned int lazy)
+{
+    if (key_store->indexStore == NULL)
+    {
+        return;
+    }
+
+    KeystoreRamFV_IndexEntry_t *tag = &key_store->indexStore[key_store->indexSize];
+
+    key_store->indexGeneration = lazy ? tag->generation + 1 : 0;
+
+    if (0 == key_store->indexGeneration)
+    {
+        for (unsigned long k = 0; k < key_store->indexSize; k++)
+        {
+            key_store->indexStore[k].hash = 0;
+            key_store->indexStore[k].element = 0;
+            key_store->indexStore[k].generation = 0;
+        }
+
+        key_store->indexGeneration = 1;
+    }
+
+    tag->generation = key_store->indexGeneration;
+    key_store->indexMaxProbe = 0;
+}
+
+
+static unsigned int
+isIndexEntryUsed(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_IndexEntry_t const *entry)
+{
+    return 0 != entry->element &&
+           key_store->indexGeneration == entry->generation;
+}
+
+
+static unsigned long
+indexFind(
+    KeystoreRamFV_t const *key_store,
+    const unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    unsigned long hash = hashKey(appId, name);
+    unsigned long pos = hash % key_store->indexSize;
+
+    // no entry has ever been placed further than indexMaxProbe from its home
+    for (unsigned long probe = 0; probe <= key_store->indexMaxProbe; probe++)
+    {
+        // read once and checked before use, as an optimistic reader may see
+        // the entry change while it is being written
+        KeystoreRamFV_IndexEntry_t entry = key_store->indexStore[pos];
+
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+
+        if (!isIndexEntryUsed(key_store, &entry))
+        {
+            break;
+        }
+
+        if (hash == entry.hash && entry.element <= key_store->maxElements)
+        {
+            unsigned long k = entry.element - 1;
+
+            // a stale copy of the key may precede the live one
+            if (appId == elementAdmin(key_store, k)->appId &&
+                isSameName(key_store, name, elementName(key_store, k)) &&
+                isLive(key_store, k))
+            {
+                return k;
+            }
+        }
+
+        pos = nextIndexPos(key_store, pos);
+    }
+
+    return key_store->maxElements;
+}
+
+
+static void
+indexInsert(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned long hash = hashKey(
+                             elementAdmin(key_store, index)->appId,
+                             elementName(key_store, index));
+    unsigned long pos = hash % key_store->indexSize;
+    unsigned long probe = 0;
+
+    // the table is never more than half full, so there is a free entry
+    while (isIndexEntryUsed(key_store, &key_store->indexStore[pos]))
+    {
+        pos = nextIndexPos(key_store, pos);
+        probe++;
+    }
+
+    key_store->indexStore[pos].hash = hash;
+    key_store->indexStore[pos].element = index + 1;
+    key_store->indexStore[pos].generation = key_store->indexGeneration;
+
+    if (probe > key_store->indexMaxProbe)
+    {
+        key_store->indexMaxProbe = probe;
+    }
+}
+
+
+static void
+indexRemove(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned long hash = hashKey(
+                             elementAdmin(key_store, index)->appId,
+                             elementName(key_store, index));
+    unsigned long pos = hash % key_store->indexSize;
+
+    while (index + 1 != key_store->indexStore[pos].element ||
+           !isIndexEntryUsed(key_store, &key_store->indexStore[pos]))
     {
-        key_store->freeSlots += 1;
+        pos = nextIndexPos(key_store, pos);
+    }
+
+    // backward shift deletion, so lookups never need tombstones
+    unsigned long next = pos;
+    for (;;)
+    {
+        next = nextIndexPos(key_store, next);
+
+        if (!isIndexEntryUsed(key_store, &key_store->indexStore[next]))
+        {
+            break;
+        }
+
+        unsigned long home = key_store->indexStore[next].hash % key_store->indexSize;
+
+        // an entry whose home lies cyclically in (pos, next] has to stay
+        if ((pos <= next) ?
+            (pos < home && home <= next) :
+            (pos < home || home <= next))
+        {
+            continue;
+        }
+
+        key_store->indexStore[pos] = key_store->indexStore[next];
+        pos = next;
+    }
+
+    key_store->indexStore[pos].hash = 0;
+    key_store->indexStore[pos].element = 0;
+}
+
+
+static unsigned long
+lowestSetBit(unsigned long word)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl(word);
+#else
+    unsigned long bit = 0;
+
+    while (!(word & 1))
+    {
+        word >>= 1;
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
+
+static void
+markFree(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned long word = index / KeystoreRamFV_FREE_MAP_BITS;
+
+    key_store->freeMap[word] |= 1UL << (index % KeystoreRamFV_FREE_MAP_BITS);
+
+    if (word < key_store->freeMapHint)
+    {
+        key_store->freeMapHint = word;
+    }
+}
+
+
+// Marks all elements from index on as free and the ones before it as used,
+// writing each word of the free map once.
+static void
+markFreeFrom(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned long words = KeystoreRamFV_FREE_MAP_SIZE(key_store->maxElements);
+    unsigned long rest = key_store->maxElements % KeystoreRamFV_FREE_MAP_BITS;
+
+    for (unsigned long w = 0; w < words; w++)
+    {
+        unsigned long begin = w * KeystoreRamFV_FREE_MAP_BITS;
+        unsigned long word = ~0UL;
+
+        if (index >= begin + KeystoreRamFV_FREE_MAP_BITS)
+        {
+            word = 0;
+        }
+        else if (index > begin)
+        {
+            word <<= index - begin;
+        }
+
+        if (w == words - 1 && rest != 0)
+        {
+            word &= (1UL << rest) - 1;
+        }
+
+        key_store->freeMap[w] = word;
+    }
+}
+
+
+static void
+markUsed(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    key_store->freeMap[index / KeystoreRamFV_FREE_MAP_BITS] &=
+        ~(1UL << (index % KeystoreRamFV_FREE_MAP_BITS));
+}
+
+
+static void
+linkApp(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned int appId = elementAdmin(key_store, index)->appId;
+    unsigned long head = key_store->appHead[appId];
+
+    elementAdmin(key_store, index)->appPrev = key_store->maxElements;
+    elementAdmin(key_store, index)->appNext = head;
+
+    if (head != key_store->maxElements)
+    {
+        elementAdmin(key_store, head)->appPrev = index;
+    }
+
+    key_store->appHead[appId] = index;
+}
+
+
+static void
+unlinkApp(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    unsigned long next = elementAdmin(key_store, index)->appNext;
+    unsigned long prev = elementAdmin(key_store, index)->appPrev;
+
+    if (prev != key_store->maxElements)
+    {
+        elementAdmin(key_store, prev)->appNext = next;
+    }
+    else
+    {
+        key_store->appHead[elementAdmin(key_store, index)->appId] = next;
+    }
+
+    if (next != key_store->maxElements)
+    {
+        elementAdmin(key_store, next)->appPrev = prev;
+    }
+}
+
+
+static void
+clearCache(KeystoreRamFV_t *key_store)
+{
+    KeystoreRamFV_LookupCache_t *cache = key_store->lookupCache;
+
+    if (cache != NULL)
+    {
+        zeroBytes(
+            key_store,
+            cache->entries,
+            cache->nrSets * KeystoreRamFV_CACHE_WAYS * sizeof(KeystoreRamFV_CacheEntry_t));
+    }
+}
+
+
+static void
+clearAppLists(KeystoreRamFV_t *key_store)
+{
+    for (unsigned int k = 0; k <= KeystoreRamFV_MAX_APP_ID; k++)
+    {
+        key_store->appHead[k] = key_store->maxElements;
+    }
+}
+
+
+static void
+resetElementKey(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    zeroBytes(
+        key_store,
+        elementName(key_store, index),
+        KeystoreRamFV_KEY_NAME_SIZE);
+    // only the data in use has ever been written since the last reset
+    zeroBytes(
+        key_store,
+        elementData(key_store, index),
+        elementAdmin(key_store, index)->dataSize);
+    elementAdmin(key_store, index)->dataSize = 0;
+
+    if (key_store->fingerprints != NULL)
+    {
+        key_store->fingerprints[index] = 0;
+    }
+
+    if (key_store->hitCounters != NULL)
+    {
+        key_store->hitCounters[index] = 0;
+    }
+}
+
+
+static void
+releaseElement(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    if (key_store->indexStore != NULL)
+    {
+        indexRemove(key_store, index);
+    }
+
+    unlinkApp(key_store, index);
+
+    elementAdmin(key_store, index)->isFree = 1;
+    elementAdmin(key_store, index)->appId = 0;
+
+    resetElementKey(key_store, index);
+    elementAdmin(key_store, index)->generation += 1;
+
+    if (key_store->freeMap != NULL)
+    {
+        markFree(key_store, index);
+    }
+}
+
+
+static void
+initElement(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    elementAdmin(key_store, index)->isFree = 1;
+    elementAdmin(key_store, index)->appId = 0;
+    // nothing is known about the previous content, so reset all of it
+    elementAdmin(key_store, index)->dataSize = KeystoreRamFV_KEY_DATA_SIZE;
+    // keeps views taken before the re-initialization invalid
+    elementAdmin(key_store, index)->generation += 1;
+    *elementReadOnly(key_store, index) = 0;
+    resetElementKey(key_store, index);
+}
+
+
+// Checks the keys to be loaded for duplicates, also with the keys of the read
+// only segment, in expected linear time with a chained hash table. The first
+// nrKeys elements serve as its memory, with appPrev as bucket head and appNext
+// as chain link, so it must run before they are occupied.
+static unsigned int
+hasDuplicateKeys(
+    KeystoreRamFV_t *key_store,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nr_keys)
+{
+    for (unsigned long k = 0; k < nr_keys; k++)
+    {
+        elementAdmin(key_store, k)->appPrev = nr_keys;
+    }
+
+    for (unsigned long k = 0; k < nr_keys; k++)
+    {
+        if (key_store->maxElements !=
+                findSegmentKey(key_store, appIds[k], keys[k].name))
+        {
+            return 1;
+        }
+
+        unsigned long bucket = hashKey(appIds[k], keys[k].name) % nr_keys;
+        unsigned long j = elementAdmin(key_store, bucket)->appPrev;
+
+        while (j < nr_keys)
+        {
+            if (appIds[j] == appIds[k] &&
+                isSameName(key_store, keys[j].name, keys[k].name))
+            {
+                return 1;
+            }
+
+            j = elementAdmin(key_store, j)->appNext;
+        }
+
+        elementAdmin(key_store, k)->appNext = elementAdmin(key_store, bucket)->appPrev;
+        elementAdmin(key_store, bucket)->appPrev = k;
+    }
+
+    return 0;
+}
+
+
+// Makes the free element at the high water mark part of the used range,
+// initializing it if that has not happened yet.
+static unsigned long
+extendHighWater(KeystoreRamFV_t *key_store)
+{
+    unsigned long index = key_store->highWater;
+
+    if (index == key_store->initializedElements)
+    {
+        initElement(key_store, index);
+        key_store->initializedElements++;
+    }
+
+    key_store->highWater++;
+    return index;
+}
+
+
+static void
+deleteElement(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    if (!elementAdmin(key_store, index)->isFree)
+    {
+        // stale elements have been counted as free already
+        if (isLive(key_store, index))
+        {
+            key_store->freeSlots += 1;
+        }
+
+        releaseElement(key_store, index);
+    }
+}
+
+
+// Scrubs the element if it is stale, so it can be occupied.
+static void
+claimElement(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    if (!elementAdmin(key_store, index)->isFree)
+    {
+        releaseElement(key_store, index);
+    }
+}
+
+
+// Advances the scrub cursor to the first stale element at or after it.
+static unsigned long
+findStaleElement(KeystoreRamFV_t *key_store)
+{
+    while (key_store->scrubCursor < key_store->highWater &&
+           (elementAdmin(key_store, key_store->scrubCursor)->isFree ||
+            isLive(key_store, key_store->scrubCursor)))
+    {
+        key_store->scrubCursor++;
+    }
+
+    return (key_store->scrubCursor < key_store->highWater) ?
+           key_store->scrubCursor : key_store->maxElements;
+}
+
+
+// Makes the free element, whose name and data are in place, hold a key.
+static void
+admitElement(
+    KeystoreRamFV_t *key_store,
+    unsigned long index,
+    unsigned int appId,
+    unsigned int readOnly,
+    unsigned long dataSize)
+{
+    if (key_store->freeMap != NULL)
+    {
+        markUsed(key_store, index);
+    }
+
+    elementAdmin(key_store, index)->isFree = 0;
+    elementAdmin(key_store, index)->appId = appId;
+    elementAdmin(key_store, index)->dataSize = dataSize;
+    elementAdmin(key_store, index)->epoch = key_store->epoch;
+
+    *elementReadOnly(key_store, index) = readOnly;
+
+    if (key_store->fingerprints != NULL)
+    {
+        key_store->fingerprints[index] =
+            fingerprintOf(hashKey(appId, elementName(key_store, index)));
+    }
+
+    if (key_store->hitCounters != NULL)
+    {
+        key_store->hitCounters[index] = 0;
+    }
+
+    if (key_store->indexStore != NULL)
+    {
+        indexInsert(key_store, index);
+    }
+
+    linkApp(key_store, index);
+}
+
+
+static void
+occupyElement(
+    KeystoreRamFV_t *key_store,
+    unsigned long index,
+    unsigned int appId,
+    unsigned int readOnly,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    copyBytes(
+        key_store,
+        elementName(key_store, index),
+        key->name,
+        KeystoreRamFV_KEY_NAME_SIZE);
+    // the free element is zero beyond what is copied here
+    copyBytes(
+        key_store,
+        elementData(key_store, index),
+        key->data,
+        dataSize);
+
+    admitElement(key_store, index, appId, readOnly, dataSize);
+}
+
+
+static unsigned int
+isCandidate(
+    KeystoreRamFV_t const *key_store,
+    unsigned long index,
+    unsigned int appId)
+{
+    return isLive(key_store, index) &&
+           appId == elementAdmin(key_store, index)->appId;
+}
+
+
+static unsigned int
+isKeyAt(
+    KeystoreRamFV_t const *key_store,
+    unsigned long index,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    return isSameName(key_store, name, elementName(key_store, index)) &&
+           isCandidate(key_store, index, appId);
+}
+
+
+// Like scanElements(), but looks only at the elements whose fingerprint
+// matches, so a miss hardly touches any element.
+static unsigned long
+scanFingerprints(
+    KeystoreRamFV_t const *key_store,
+    unsigned long end,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    unsigned char const *fingerprints = key_store->fingerprints;
+    unsigned char fingerprint = fingerprintOf(hashKey(appId, name));
+    unsigned long k = 0;
+
+#if defined(KeystoreRamFV_SCAN_SSE2)
+#   if defined(KeystoreRamFV_SCAN_AVX2)
+    __m256i target32 = _mm256_set1_epi8((char) fingerprint);
+
+    for (; k + 32 <= end; k += 32)
+    {
+        unsigned long hits = (unsigned int) _mm256_movemask_epi8(
+                                 _mm256_cmpeq_epi8(
+                                     _mm256_loadu_si256(
+                                         (__m256i const *) (fingerprints + k)),
+                                     target32));
+
+        for (; hits != 0; hits &= hits - 1)
+        {
+            unsigned long index = k + lowestSetBit(hits);
+
+            if (isKeyAt(key_store, index, appId, name))
+            {
+                return index;
+            }
+        }
+    }
+#   endif
+
+    __m128i target16 = _mm_set1_epi8((char) fingerprint);
+
+    for (; k + 16 <= end; k += 16)
+    {
+        unsigned long hits = (unsigned int) _mm_movemask_epi8(
+                                 _mm_cmpeq_epi8(
+                                     _mm_loadu_si128(
+                                         (__m128i const *) (fingerprints + k)),
+                                     target16));
+
+        for (; hits != 0; hits &= hits - 1)
+        {
+            unsigned long index = k + lowestSetBit(hits);
+
+            if (isKeyAt(key_store, index, appId, name))
+            {
+                return index;
+            }
+        }
+    }
+#endif
+
+    for (; k < end; k++)
+    {
+        if (fingerprint == fingerprints[k] && isKeyAt(key_store, k, appId, name))
+        {
+            return k;
+        }
+    }
+
+    return end;
+}
+
+
+// Returns the first live element below end holding the key, end if there is
+// none. Most elements differ in the name, so it is compared first and the
+// admin header is only looked at for elements with a matching name.
+static unsigned long
+scanElements(
+    KeystoreRamFV_t const *key_store,
+    unsigned long end,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    unsigned long k = 0;
+
+    if (key_store->fingerprints != NULL)
+    {
+        return scanFingerprints(key_store, end, appId, name);
+    }
+
+#if defined(KeystoreRamFV_SCAN_SSE2) && (16 == KeystoreRamFV_KEY_NAME_SIZE)
+    char const *names = key_store->layout.name;
+    unsigned long stride = key_store->layout.nameStride;
+    __m128i target = _mm_loadu_si128((__m128i const *) name);
+
+#   if defined(KeystoreRamFV_SCAN_AVX2)
+    // the names of a split store are adjacent, two fit into a register
+    if (KeystoreRamFV_KEY_NAME_SIZE == stride)
+    {
+        __m256i target2 = _mm256_broadcastsi128_si256(target);
+
+        for (; k + 2 <= end; k += 2)
+        {
+            KeystoreRamFV_COUNT(key_store, comparisons, 2);
+
+            unsigned int equal = (unsigned int) _mm256_movemask_epi8(
+                                     _mm256_cmpeq_epi8(
+                                         _mm256_loadu_si256(
+                                             (__m256i const *) (names + k * stride)),
+                                         target2));
+
+            if (0xffff == (equal & 0xffff) && isCandidate(key_store, k, appId))
+            {
+                return k;
+            }
+
+            if (0xffff == (equal >> 16) && isCandidate(key_store, k + 1, appId))
+            {
+                return k + 1;
+            }
+        }
+    }
+#   endif
+
+    for (; k + 4 <= end; k += 4)
+    {
+        KeystoreRamFV_COUNT(key_store, comparisons, 4);
+
+        char const *p = names + k * stride;
+        unsigned int matches =
+            (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(
+                           _mm_loadu_si128((__m128i const *) p), target))) |
+            ((0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(
+                            _mm_loadu_si128((__m128i const *) (p + stride)), target))) << 1) |
+            ((0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(
+                            _mm_loadu_si128((__m128i const *) (p + 2 * stride)), target))) << 2) |
+            ((0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(
+                            _mm_loadu_si128((__m128i const *) (p + 3 * stride)), target))) << 3);
+
+        for (unsigned long j = 0; matches != 0; j++, matches >>= 1)
+        {
+            if ((matches & 1) && isCandidate(key_store, k + j, appId))
+            {
+                return k + j;
+            }
+        }
+    }
+
+    for (; k < end; k++)
+    {
+        KeystoreRamFV_COUNT(key_store, comparisons, 1);
+
+        if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(
+                          _mm_loadu_si128((__m128i const *) (names + k * stride)),
+                          target)) &&
+            isCandidate(key_store, k, appId))
+        {
+            return k;
+        }
+    }
+#else
+    for (; k < end; k++)
+    {
+        if (name[0] == elementName(key_store, k)[0] &&
+            isSameName(key_store, name, elementName(key_store, k)) &&
+            isCandidate(key_store, k, appId))
+        {
+            return k;
+        }
+    }
+#endif
+
+    return end;
+}
+
+
+static unsigned long
+findElement(
+    KeystoreRamFV_t const *key_store,
+    unsigned long max,
+    const unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    if (name == NULL)
+    {
+        return max;
+    }
+
+    if (max > key_store->maxElements)
+    {
+        max = key_store->maxElements;
+    }
+
+    unsigned long segment_index = findSegmentKey(key_store, appId, name);
+    if (segment_index != key_store->maxElements)
+    {
+        return segment_index;
+    }
+
+    if (key_store->indexStore != NULL)
+    {
+        unsigned long k = indexFind(key_store, appId, name);
+        return (k < max) ? k : max;
+    }
+
+    // there are only free elements from the high water mark on
+    unsigned long end = (max < key_store->highWater) ? max : key_store->highWater;
+    unsigned long k = scanElements(key_store, end, appId, name);
+
+    KeystoreRamFV_COUNT(key_store, slotsScanned, (k < end) ? k + 1 : end);
+    return (k < end) ? k : max;
+}
+
+// Returns the lowest element marked free in the free map, or maxElements.
+static unsigned long
+findFreeBit(KeystoreRamFV_t *key_store)
+{
+    unsigned long words = KeystoreRamFV_FREE_MAP_SIZE(key_store->maxElements);
+    unsigned long index = key_store->maxElements;
+
+    for (unsigned long w = key_store->freeMapHint; w < words; w++)
+    {
+        if (0 != key_store->freeMap[w])
+        {
+            index = w * KeystoreRamFV_FREE_MAP_BITS +
+                    lowestSetBit(key_store->freeMap[w]);
+            break;
+        }
+    }
+
+    key_store->freeMapHint = index / KeystoreRamFV_FREE_MAP_BITS;
+    return index;
+}
+
+
+// Returns the lowest element that is not live, scrubbed if it was stale.
+static unsigned long
+findFreeElement(KeystoreRamFV_t *key_store)
+{
+    if (key_store->freeMap != NULL)
+    {
+        unsigned long index = findFreeBit(key_store);
+
+        // stale elements are not in the free map, and none precede the cursor
+        unsigned long stale_index = findStaleElement(key_store);
+        if (stale_index < index)
+        {
+            releaseElement(key_store, stale_index);
+            return stale_index;
+        }
+
+        // all elements from the high water mark on are in the free map
+        if (index < key_store->maxElements && index >= key_store->highWater)
+        {
+            return extendHighWater(key_store);
+        }
+
+        return index;
+    }
+
+    for (unsigned long k = 0; k < key_store->highWater; k++)
+    {
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+
+        if (!isLive(key_store, k))
+        {
+            claimElement(key_store, k);
+            return k;
+        }
+    }
+
+    if (key_store->highWater < key_store->maxElements)
+    {
+        return extendHighWater(key_store);
+    }
+
+    return key_store->maxElements;
+}
+
+// Keys of a batch hashed into one table on the stack, and so resolved with one
+// scan over the elements; larger batches are resolved a window after the other.
+#define KeystoreRamFV_BATCH_WINDOW  64
+#define KeystoreRamFV_BATCH_BUCKETS (2 * KeystoreRamFV_BATCH_WINDOW)
+
+// Resolves the up to KeystoreRamFV_BATCH_WINDOW keys of a window whose result
+// is still without error, leaving maxElements as index if not found. Keys of the
+// read only segment are resolved first. A key equal to an earlier one of the
+// window is resolved like it, or with repeatsFound as found at maxElements + 1,
+// which is what adding it has to see.
+static void
+findWindow(
+    KeystoreRamFV_t const *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    char const *names,
+    unsigned long nameStride,
+    KeystoreRamFV_Result_t *results,
+    unsigned int repeatsFound)
+{
+    unsigned char heads[KeystoreRamFV_BATCH_BUCKETS];
+    unsigned char next[KeystoreRamFV_BATCH_WINDOW];
+    unsigned char first[KeystoreRamFV_BATCH_WINDOW];
+    unsigned long unresolved = 0;
+
+    for (unsigned long b = 0; b < KeystoreRamFV_BATCH_BUCKETS; b++)
+    {
+        heads[b] = KeystoreRamFV_BATCH_WINDOW;
+    }
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        char const *name = names + i * nameStride;
+
+        results[i].index = key_store->maxElements;
+        first[i] = (unsigned char) i;
+
+        if (KeystoreRamFV_ERR_NONE != results[i].error)
+        {
+            continue;
+        }
+
+        results[i].index = findSegmentKey(key_store, appIds[i], name);
+        if (key_store->maxElements != results[i].index)
+        {
+            continue;
+        }
+
+        unsigned long bucket = hashKey(appIds[i], name) % KeystoreRamFV_BATCH_BUCKETS;
+        unsigned long j = heads[bucket];
+
+        while (j < KeystoreRamFV_BATCH_WINDOW &&
+               !(appIds[j] == appIds[i] &&
+                 isSameName(key_store, names + j * nameStride, name)))
+        {
+            j = next[j];
+        }
+
+        if (j < KeystoreRamFV_BATCH_WINDOW)
+        {
+            first[i] = (unsigned char) j;
+            continue;
+        }
+
+        next[i] = heads[bucket];
+        heads[bucket] = (unsigned char) i;
+
+        if (key_store->indexStore != NULL)
+        {
+            results[i].index = indexFind(key_store, appIds[i], name);
+            continue;
+        }
+
+        unresolved++;
+    }
+
+    for (unsigned long k = 0; k < key_store->highWater && unresolved > 0; k++)
+    {
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+
+        if (!isLive(key_store, k))
+        {
+            continue;
+        }
+
+        unsigned int app_id = elementAdmin(key_store, k)->appId;
+        char const *name = elementName(key_store, k);
+        unsigned long j = heads[hashKey(app_id, name) % KeystoreRamFV_BATCH_BUCKETS];
+
+        // the keys in the table are all different, so one matches at most
+        while (j < KeystoreRamFV_BATCH_WINDOW)
+        {
+            if (key_store->maxElements == results[j].index &&
+                appIds[j] == app_id &&
+                isSameName(key_store, names + j * nameStride, name))
+            {
+                results[j].index = k;
+                unresolved--;
+                break;
+            }
+
+            j = next[j];
+        }
+    }
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        if (first[i] != i)
+        {
+            results[i].index = repeatsFound ?
+                               key_store->maxElements + 1 : results[first[i]].index;
+        }
+    }
+}
+
+
+// Resolves all keys of a batch like findWindow(), a window after the other.
+static void
+findElements(
+    KeystoreRamFV_t const *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    char const *names,
+    unsigned long nameStride,
+    KeystoreRamFV_Result_t *results,
+    unsigned int repeatsFound)
+{
+    for (unsigned long w = 0; w < nr_keys; w += KeystoreRamFV_BATCH_WINDOW)
+    {
+        unsigned long window = nr_keys - w;
+
+        if (window > KeystoreRamFV_BATCH_WINDOW)
+        {
+            window = KeystoreRamFV_BATCH_WINDOW;
+        }
+
+        findWindow(
+            key_store,
+            window,
+            appIds + w,
+            names + w * nameStride,
+            nameStride,
+            results + w,
+            repeatsFound);
+    }
+}
+
+void
+KeystoreRamFV_init(
+    KeystoreRamFV_t *key_store,
+    unsigned long maxElements,
+    KeystoreRamFV_ElementRecord_t *elementStore)
+{
+    KeystoreRamFV_Config_t config = {0};
+
+    config.maxElements = maxElements;
+    config.elementStore = elementStore;
+    KeystoreRamFV_initWithConfig(key_store, &config, NULL, NULL, 0);
+}
+
+unsigned int
+KeystoreRamFV_initWithReadOnlyKeys(
+    KeystoreRamFV_t *key_store,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nr_keys,
+    unsigned long maxElements,
+    KeystoreRamFV_ElementRecord_t *elementStore)
+{
+    KeystoreRamFV_Config_t config = {0};
+
+    config.maxElements = maxElements;
+    config.elementStore = elementStore;
+    return KeystoreRamFV_initWithConfig(
+               key_store,
+               &config,
+               appIds,
+               keys,
+               nr_keys);
+}
+
+// Checks the configuration and takes it over, with no key in the index, the
+// app lists and the free map yet.
+static unsigned int
+setupStore(
+    KeystoreRamFV_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int lazy)
+{
+    if (config == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (config->elementStore != NULL && config->splitStore != NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (config->readOnlySegment != NULL &&
+        config->readOnlySegment->nrKeys > 0 &&
+        (config->readOnlySegment->keys == NULL ||
+         config->readOnlySegment->seeds == NULL ||
+         config->readOnlySegment->table == NULL ||
+         0 == config->readOnlySegment->nrBuckets ||
+         0 == config->readOnlySegment->tableSize))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (config->indexStore != NULL &&
+        config->indexSize < KeystoreRamFV_INDEX_SIZE(config->maxElements))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (config->lookupCache != NULL &&
+        (config->lookupCache->entries == NULL || 0 == config->lookupCache->nrSets))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    key_store->maxElements = config->maxElements;
+    setupLayout(key_store, config);
+    key_store->indexStore = config->indexStore;
+    // without the entry after the table that keeps its generation
+    key_store->indexSize =
+        (config->indexStore != NULL) ? config->indexSize - 1 : 0;
+    key_store->freeMap = config->freeMap;
+    key_store->freeMapHint = 0;
+    key_store->readOnlySegment = config->readOnlySegment;
+    key_store->fingerprints = config->fingerprints;
+    key_store->hitCounters = config->hitCounters;
+    key_store->lookupCache = config->lookupCache;
+#if defined(KeystoreRamFV_STATISTICS)
+    key_store->statistics = config->statistics;
+#endif
+#if defined(KeystoreRamFV_TIMING)
+    key_store->timing = config->timing;
+#endif
+    key_store->epoch = 0;
+    key_store->scrubCursor = key_store->maxElements;
+
+    resetIndex(key_store, lazy);
+    clearAppLists(key_store);
+    clearCache(key_store);
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+static unsigned int
+initStore(
+    KeystoreRamFV_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nr_keys)
+{
+    unsigned int result = setupStore(key_store, config, config != NULL && config->lazyInit);
+
+    if (KeystoreRamFV_ERR_NONE != result)
+    {
+        return result;
+    }
+
+    if (nr_keys > key_store->maxElements)
+    {
+        nr_keys = 0;
+        result = -1;
+    }
+
+    // a key of an invalid app id must not be linked, so it empties the keystore
+    for (unsigned long k = 0; k < nr_keys; k++)
+    {
+        if (appIds[k] > KeystoreRamFV_MAX_APP_ID)
+        {
+            nr_keys = 0;
+            result = KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+    }
+
+    // if there is a duplicate, return an empty keystore
+    if (hasDuplicateKeys(key_store, appIds, keys, nr_keys))
+    {
+        nr_keys = 0;
+        result = KeystoreRamFV_ERR_DUPLICATED;
+    }
+
+    key_store->highWater = nr_keys;
+
+    for (unsigned long k = 0; k < nr_keys; k++)
+    {
+        elementAdmin(key_store, k)->generation += 1;
+        occupyElement(
+            key_store,
+            k,
+            appIds[k],
+            1,
+            &keys[k],
+            KeystoreRamFV_KEY_DATA_SIZE);
+    }
+
+    // with lazy initialization, only elements that may hold a key are reset now
+    key_store->initializedElements =
+        config->lazyInit ? nr_keys : key_store->maxElements;
+
+    for (unsigned long k = nr_keys; k < key_store->initializedElements; k++)
+    {
+        initElement(key_store, k);
+    }
+
+    if (key_store->freeMap != NULL)
+    {
+        markFreeFrom(key_store, nr_keys);
+    }
+
+    key_store->readOnlySlots = nr_keys;
+    key_store->freeSlots = key_store->maxElements - nr_keys;
+    return result;
+}
+
+unsigned long
+KeystoreRamFV_getLayoutVersion(void)
+{
+    return KeystoreRamFV_LAYOUT_VERSION;
+}
+
+
+// Zeroes the bytes no key uses, the data after dataSize and all of a free
+// element, where the attached memory does not hold zero there already, so
+// later keys do not read or leak what was left.
+static void
+scrubUnusedBytes(KeystoreRamFV_t *key_store, unsigned long index)
+{
+    KeystoreRamFV_ElementAdmin_t const *admin = elementAdmin(key_store, index);
+    char *name = elementName(key_store, index);
+    char *data = elementData(key_store, index);
+
+    if (admin->isFree)
+    {
+        for (unsigned long b = 0; b < KeystoreRamFV_KEY_NAME_SIZE; b++)
+        {
+            if (name[b] != 0)
+            {
+                zeroBytes(key_store, name, KeystoreRamFV_KEY_NAME_SIZE);
+                break;
+            }
+        }
+    }
+
+    unsigned long used = admin->isFree ? 0 : admin->dataSize;
+
+    for (unsigned long b = used; b < KeystoreRamFV_KEY_DATA_SIZE; b++)
+    {
+        if (data[b] != 0)
+        {
+            zeroBytes(key_store, data + used, KeystoreRamFV_KEY_DATA_SIZE - used);
+            break;
+        }
+    }
+}
+
+
+// Checks the live keys of the elements to be attached for duplicates, also
+// with the keys of the read only segment, without writing to the elements. With
+// an index it is built on the way, in expected linear time; without one, the
+// keys of an app id are compared pairwise, as every lookup then scans anyway.
+static unsigned int
+hasDuplicateElements(KeystoreRamFV_t *key_store)
+{
+    unsigned long max = key_store->maxElements;
+
+    for (unsigned long k = 0; k < max; k++)
+    {
+        KeystoreRamFV_ElementAdmin_t const *admin = elementAdmin(key_store, k);
+        char const *name = elementName(key_store, k);
+
+        if (!isLive(key_store, k))
+        {
+            continue;
+        }
+
+        if (max != findSegmentKey(key_store, admin->appId, name))
+        {
+            return 1;
+        }
+
+        if (key_store->indexStore != NULL)
+        {
+            if (max != indexFind(key_store, admin->appId, name))
+            {
+                return 1;
+            }
+
+            indexInsert(key_store, k);
+            continue;
+        }
+
+        for (unsigned long j = 0; j < k; j++)
+        {
+            if (isLive(key_store, j) &&
+                elementAdmin(key_store, j)->appId == admin->appId &&
+                isSameName(key_store, elementName(key_store, j), name))
+            {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+unsigned int
+KeystoreRamFV_attach(
+    KeystoreRamFV_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    unsigned long epoch)
+{
+    unsigned int result = setupStore(key_store, config, 0);
+
+    if (KeystoreRamFV_ERR_NONE != result)
+    {
+        return result;
+    }
+
+    key_store->epoch = epoch;
+    key_store->highWater = 0;
+    key_store->initializedElements = key_store->maxElements;
+    key_store->readOnlySlots = 0;
+    key_store->freeSlots = key_store->maxElements;
+
+    // nothing is written to the elements before all of them are checked
+    for (unsigned long k = 0; k < key_store->maxElements; k++)
+    {
+        KeystoreRamFV_ElementAdmin_t const *admin = elementAdmin(key_store, k);
+        unsigned int read_only = *elementReadOnly(key_store, k);
+
+        if (admin->isFree > 1 || read_only > 1 ||
+            admin->appId > KeystoreRamFV_MAX_APP_ID ||
+            admin->dataSize > KeystoreRamFV_KEY_DATA_SIZE)
+        {
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+    }
+
+    if (hasDuplicateElements(key_store))
+    {
+        return KeystoreRamFV_ERR_DUPLICATED;
+    }
+
+    // the keys are inserted again when they are admitted
+    resetIndex(key_store, 1);
+
+    // the free elements are marked one by one
+    if (key_store->freeMap != NULL)
+    {
+        markFreeFrom(key_store, key_store->maxElements);
+    }
+
+    for (unsigned long k = 0; k < key_store->maxElements; k++)
+    {
+        KeystoreRamFV_ElementAdmin_t const *admin = elementAdmin(key_store, k);
+
+        // stale elements are scrubbed right away
+        if (!admin->isFree && !isLive(key_store, k))
+        {
+            initElement(key_store, k);
+        }
+
+        scrubUnusedBytes(key_store, k);
+
+        if (admin->isFree)
+        {
+            if (key_store->fingerprints != NULL)
+            {
+                key_store->fingerprints[k] = 0;
+            }
+            if (key_store->freeMap != NULL)
+            {
+                markFree(key_store, k);
+            }
+            continue;
+        }
+
+        unsigned int read_only = *elementReadOnly(key_store, k);
+
+        admitElement(key_store, k, admin->appId, read_only, admin->dataSize);
+        key_store->freeSlots -= 1;
+        key_store->readOnlySlots += read_only;
+        key_store->highWater = k + 1;
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+unsigned int
+KeystoreRamFV_initWithConfig(
+    KeystoreRamFV_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nr_keys)
+{
+    KeystoreRamFV_TIME_START((config != NULL) ? config->timing : NULL);
+    unsigned int result = initStore(key_store, config, appIds, keys, nr_keys);
+
+    // a rejected configuration leaves the store, and so its counters, alone
+    if (KeystoreRamFV_ERR_INVALID_PARAMETER != result)
+    {
+        KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_INIT);
+        KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_INIT, result);
+    }
+
+    return result;
+}
+
+
+void
+KeystoreRamFV_wipe(KeystoreRamFV_t *key_store)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+
+    for (unsigned long k = 0; k < key_store->highWater; k++)
+    {
+        if (!elementAdmin(key_store, k)->isFree &&
+            !*elementReadOnly(key_store, k))
+        {
+            deleteElement(key_store, k);
+        }
+    }
+
+    key_store->scrubCursor = key_store->maxElements;
+    clearCache(key_store);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_WIPE);
+    KeystoreRamFV_COUNT(key_store, slotsScanned, key_store->highWater);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_WIPE, KeystoreRamFV_ERR_NONE);
+}
+
+
+void
+KeystoreRamFV_wipeDeferred(KeystoreRamFV_t *key_store)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+
+    // all elements of the previous epochs that are not read only are stale
+    key_store->epoch += 1;
+    key_store->freeSlots = key_store->maxElements - key_store->readOnlySlots;
+    key_store->scrubCursor = 0;
+    clearCache(key_store);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_WIPE);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_WIPE, KeystoreRamFV_ERR_NONE);
+}
+
+
+unsigned long
+KeystoreRamFV_scrubStep(KeystoreRamFV_t *key_store, unsigned long budget)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+
+    while (budget > 0 && key_store->scrubCursor < key_store->highWater)
+    {
+        if (!elementAdmin(key_store, key_store->scrubCursor)->isFree &&
+            !isLive(key_store, key_store->scrubCursor))
+        {
+            releaseElement(key_store, key_store->scrubCursor);
+        }
+
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+        key_store->scrubCursor++;
+        budget--;
+    }
+
+    unsigned long left = (key_store->scrubCursor < key_store->highWater) ?
+                         key_store->highWater - key_store->scrubCursor : 0;
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_SCRUB);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_SCRUB, KeystoreRamFV_ERR_NONE);
+    return left;
+}
+
+
+// Lowers the high water mark to just above the highest live element,
+// scrubbing the stale elements it passes.
+static void
+trimHighWater(KeystoreRamFV_t *key_store)
+{
+    while (key_store->highWater > 0 &&
+           !isLive(key_store, key_store->highWater - 1))
+    {
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+        claimElement(key_store, key_store->highWater - 1);
+        key_store->highWater--;
+    }
+}
+
+
+// Returns the lowest element from the given one on that is not live.
+static unsigned long
+findHole(KeystoreRamFV_t *key_store, unsigned long from)
+{
+    if (key_store->freeMap != NULL)
+    {
+        unsigned long index = findFreeBit(key_store);
+        unsigned long stale_index = findStaleElement(key_store);
+
+        return (stale_index < index) ? stale_index : index;
+    }
+
+    while (from < key_store->highWater && isLive(key_store, from))
+    {
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+        from++;
+    }
+
+    return from;
+}
+
+
+// Moves the live key of element from into the element to, which is not live.
+static void
+moveElement(KeystoreRamFV_t *key_store, unsigned long from, unsigned long to)
+{
+    unsigned int app_id = elementAdmin(key_store, from)->appId;
+    unsigned long data_size = elementAdmin(key_store, from)->dataSize;
+    unsigned int hits = (key_store->hitCounters != NULL) ?
+                        key_store->hitCounters[from] : 0;
+
+    claimElement(key_store, to);
+    copyBytes(
+        key_store,
+        elementName(key_store, to),
+        elementName(key_store, from),
+        KeystoreRamFV_KEY_NAME_SIZE);
+    copyBytes(
+        key_store,
+        elementData(key_store, to),
+        elementData(key_store, from),
+        data_size);
+
+    // zeroes the vacated element and moves it out of the index and app list
+    releaseElement(key_store, from);
+    admitElement(key_store, to, app_id, 0, data_size);
+
+    if (key_store->hitCounters != NULL)
+    {
+        key_store->hitCounters[to] = hits;
+    }
+}
+
+
+unsigned long
+KeystoreRamFV_compact(
+    KeystoreRamFV_t *key_store,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned long hole = 0;
+    unsigned long left = 0;
+
+    for (;;)
+    {
+        trimHighWater(key_store);
+
+        // a read only key on top cannot be moved, so nothing below it helps
+        unsigned long top = key_store->highWater - 1;
+        if (0 == key_store->highWater || *elementReadOnly(key_store, top))
+        {
+            break;
+        }
+
+        hole = findHole(key_store, hole);
+        if (hole >= top)
+        {
+            break;
+        }
+
+        if (0 == budget)
+        {
+            left = key_store->highWater -
+                   (key_store->maxElements - key_store->freeSlots);
+            break;
+        }
+
+        unsigned int app_id = elementAdmin(key_store, top)->appId;
+
+        moveElement(key_store, top, hole);
+        if (relocate != NULL)
+        {
+            relocate(context, app_id, elementName(key_store, hole), top, hole);
+        }
+
+        budget--;
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_COMPACT);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_COMPACT, KeystoreRamFV_ERR_NONE);
+    return left;
+}
+
+
+// Exchanges the keys of two live elements, with their hit counters.
+static void
+swapElements(KeystoreRamFV_t *key_store, unsigned long a, unsigned long b)
+{
+    KeystoreRamFV_KeyRecord_t key;
+    unsigned int app_id = elementAdmin(key_store, a)->appId;
+    unsigned long data_size = elementAdmin(key_store, a)->dataSize;
+    unsigned int hits = key_store->hitCounters[a];
+
+    copyBytes(key_store, key.name, elementName(key_store, a), KeystoreRamFV_KEY_NAME_SIZE);
+    copyBytes(key_store, key.data, elementData(key_store, a), data_size);
+
+    releaseElement(key_store, a);
+    moveElement(key_store, b, a);
+    occupyElement(key_store, b, app_id, 0, &key, data_size);
+    key_store->hitCounters[b] = hits;
+
+    // no copy of the key is left behind on the stack
+    zeroBytes(key_store, key.name, KeystoreRamFV_KEY_NAME_SIZE);
+    zeroBytes(key_store, key.data, data_size);
+}
+
+
+unsigned long
+KeystoreRamFV_adapt(
+    KeystoreRamFV_t *key_store,
+    unsigned int hysteresis,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned long moved = 0;
+
+    if (key_store->hitCounters == NULL)
+    {
+        KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ADAPT);
+        KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_ADAPT, KeystoreRamFV_ERR_INVALID_PARAMETER);
+        return 0;
+    }
+
+    unsigned int *hits = key_store->hitCounters;
+
+    // downwards, so a hot key can rise all the way in one pass
+    for (unsigned long k = key_store->highWater; k-- > 1; )
+    {
+        KeystoreRamFV_COUNT(key_store, slotsScanned, 1);
+
+        if (!isLive(key_store, k) || *elementReadOnly(key_store, k))
+        {
+            continue;
+        }
+
+        unsigned int app_id = elementAdmin(key_store, k)->appId;
+
+        if (!isLive(key_store, k - 1))
+        {
+            moveElement(key_store, k, k - 1);
+        }
+        else if (!*elementReadOnly(key_store, k - 1) &&
+                 hits[k] > hits[k - 1] && hits[k] - hits[k - 1] > hysteresis)
+        {
+            unsigned int other_app_id = elementAdmin(key_store, k - 1)->appId;
+
+            swapElements(key_store, k, k - 1);
+            if (relocate != NULL)
+            {
+                relocate(context, other_app_id, elementName(key_store, k), k - 1, k);
+            }
+            moved++;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (relocate != NULL)
+        {
+            relocate(context, app_id, elementName(key_store, k - 1), k, k - 1);
+        }
+        moved++;
+    }
+
+    // ages the counters, so the order follows changes of the access pattern
+    for (unsigned long k = 0; k < key_store->highWater; k++)
+    {
+        hits[k] /= 2;
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ADAPT);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_ADAPT, KeystoreRamFV_ERR_NONE);
+    return moved;
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_add(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key)
+{
+    return KeystoreRamFV_addWithSize(
+               key_store,
+               appId,
+               key,
+               KeystoreRamFV_KEY_DATA_SIZE);
+}
+
+
+static KeystoreRamFV_Result_t
+addKey(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+
+    if (key == NULL)
+    {
+        return result;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return result;
+    }
+
+    if (dataSize > KeystoreRamFV_KEY_DATA_SIZE)
+    {
+        return result;
+    }
+
+    if (0 == key_store->freeSlots)
+    {
+        result.error = KeystoreRamFV_ERR_OUT_OF_SPACE;
+        return result;
+    }
+
+    if (key_store->maxElements !=
+            findElement(key_store, key_store->maxElements, appId, key->name))
+    {
+        result.error = KeystoreRamFV_ERR_DUPLICATED;
+        return result;
+    }
+
+    result.index = findFreeElement(key_store);
+
+    if (key_store->maxElements == result.index)
+    {
+        result.error = KeystoreRamFV_ERR_OUT_OF_SPACE;
+        return result;
+    }
+
+    key_store->freeSlots -= 1;
+    occupyElement(key_store, result.index, appId, 0, key, dataSize);
+
+    result.error = KeystoreRamFV_ERR_NONE;
+    return result;
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_addWithSize(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    KeystoreRamFV_Result_t result = addKey(key_store, appId, key, dataSize);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ADD);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_ADD, result.error);
+    return result;
+}
+
+
+// Counts a lookup that found the key in the element, if counting hits. Keys of
+// the read only segment, with indices after maxElements, have no counter.
+static void
+countHit(KeystoreRamFV_t const *key_store, unsigned long index)
+{
+    if (key_store->hitCounters != NULL &&
+        index < key_store->maxElements &&
+        key_store->hitCounters[index] < KeystoreRamFV_MAX_HITS)
+    {
+        key_store->hitCounters[index]++;
+    }
+}
+
+
+static KeystoreRamFV_CacheEntry_t *
+cacheSet(KeystoreRamFV_t const *key_store, unsigned long hash)
+{
+    KeystoreRamFV_LookupCache_t *cache = key_store->lookupCache;
+
+    return &cache->entries[(hash % cache->nrSets) * KeystoreRamFV_CACHE_WAYS];
+}
+
+
+// Like findElement(), but asks the lookup cache first and remembers what
+// it finds there.
+static unsigned long
+findCachedElement(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    if (key_store->lookupCache == NULL)
+    {
+        return findElement(key_store, key_store->maxElements, appId, name);
+    }
+
+    unsigned long hash = hashKey(appId, name);
+    KeystoreRamFV_CacheEntry_t *set = cacheSet(key_store, hash);
+
+    for (unsigned int w = 0; w < KeystoreRamFV_CACHE_WAYS; w++)
+    {
+        // an unused entry gives an index beyond the high water mark
+        unsigned long k = set[w].element - 1;
+
+        if (set[w].hash == hash && k < key_store->highWater &&
+            set[w].generation == elementAdmin(key_store, k)->generation &&
+            isKeyAt(key_store, k, appId, name))
+        {
+            key_store->lookupCache->hits++;
+            return k;
+        }
+    }
+
+    key_store->lookupCache->misses++;
+
+    unsigned long index = findElement(key_store, key_store->maxElements, appId, name);
+
+    // the keys of the read only segment are found before any element anyway
+    if (index < key_store->maxElements)
+    {
+        for (unsigned int w = KeystoreRamFV_CACHE_WAYS - 1; w > 0; w--)
+        {
+            set[w] = set[w - 1];
+        }
+
+        set[0].hash = hash;
+        set[0].element = index + 1;
+        set[0].generation = elementAdmin(key_store, index)->generation;
+    }
+
+    return index;
+}
+
+
+static KeystoreRamFV_Result_t
+lookupKey(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+
+    if (name == NULL)
+    {
+        return result;
+    }
+
+    if (key == NULL)
+    {
+        return result;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return result;
+    }
+
+    result.index = findCachedElement(key_store, appId, name);
+
+    if (key_store->maxElements == result.index)
+    {
+        result.error = KeystoreRamFV_ERR_NOT_FOUND;
+        return result;
+    }
+
+    countHit(key_store, result.index);
+    result.error = KeystoreRamFV_ERR_NONE;
+    return result;
+}
+
+
+static unsigned int
+checkElementIndex(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    unsigned long index)
+{
+    if (index >= segmentEnd(key_store))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (index == key_store->maxElements)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (index > key_store->maxElements)
+    {
+        return (appId == key_store->readOnlySegment->
+                             keys[index - key_store->maxElements - 1].appId) ?
+               KeystoreRamFV_ERR_NONE : KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (index >= key_store->highWater || !isLive(key_store, index))
+    {
+        return KeystoreRamFV_ERR_NOT_FOUND;
+    }
+
+    if (appId != elementAdmin(key_store, index)->appId)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+
+static unsigned int
+checkIndex(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    if (key == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    return checkElementIndex(key_store, appId, index);
+}
+
+
+static void
+copyElementKey(
+    KeystoreRamFV_t const *key_store,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long dataSize)
+{
+    if (index >= key_store->maxElements)
+    {
+        KeystoreRamFV_KeyRecord_t const *segment_key = segmentKey(key_store, index);
+
+        copyBytes(key_store, key->name, segment_key->name, KeystoreRamFV_KEY_NAME_SIZE);
+        copyBytes(key_store, key->data, segment_key->data, dataSize);
+        key->readOnly = 1;
+        return;
+    }
+
+    copyBytes(
+        key_store,
+        key->name,
+        elementName(key_store, index),
+        KeystoreRamFV_KEY_NAME_SIZE);
+    copyBytes(
+        key_store,
+        key->data,
+        elementData(key_store, index),
+        dataSize);
+    key->readOnly = *elementReadOnly(key_store, index);
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_get(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    KeystoreRamFV_Result_t result = lookupKey(key_store, appId, name, key);
+
+    if (KeystoreRamFV_ERR_NONE == result.error)
+    {
+        copyElementKey(key_store, result.index, key, KeystoreRamFV_KEY_DATA_SIZE);
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_GET, result.error);
+    return result;
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_getWithSize(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+
+    if (dataSize == NULL)
+    {
+        KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET);
+        KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_GET, result.error);
+        return result;
+    }
+
+    result = lookupKey(key_store, appId, name, key);
+
+    if (KeystoreRamFV_ERR_NONE == result.error)
+    {
+        *dataSize = keyDataSize(key_store, result.index);
+        copyElementKey(key_store, result.index, key, *dataSize);
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_GET, result.error);
+    return result;
+}
+
+unsigned int
+KeystoreRamFV_getByIndex(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = checkIndex(key_store, appId, index, key);
+
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        copyElementKey(key_store, index, key, KeystoreRamFV_KEY_DATA_SIZE);
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET_BY_INDEX);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_GET_BY_INDEX, result);
+    return result;
+}
+
+unsigned int
+KeystoreRamFV_getByIndexWithSize(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+
+    if (dataSize == NULL)
+    {
+        KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET_BY_INDEX);
+        KeystoreRamFV_COUNT_CALL(
+            key_store,
+            KeystoreRamFV_OP_GET_BY_INDEX,
+            KeystoreRamFV_ERR_INVALID_PARAMETER);
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    unsigned int result = checkIndex(key_store, appId, index, key);
+
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        *dataSize = keyDataSize(key_store, index);
+        copyElementKey(key_store, index, key, *dataSize);
+    }
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET_BY_INDEX);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_GET_BY_INDEX, result);
+    return result;
+}
+
+// Returns the first key of appId in the read only segment at or after index,
+// the end of the segment if there is none.
+static unsigned long
+nextSegmentKey(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    unsigned long index)
+{
+    unsigned long end = segmentEnd(key_store);
+
+    // the end of the list of the elements leads to the first segment key
+    if (key_store->maxElements == index)
+    {
+        index++;
+    }
+
+    while (index < end && appId != key_store->readOnlySegment->
+                                       keys[index - key_store->maxElements - 1].appId)
+    {
+        index++;
+    }
+
+    return (index < end) ? index : end;
+}
+
+static unsigned int
+iterateTo(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Iterator_t *iterator,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    // stale elements stay in the list until they are scrubbed
+    while (index < key_store->maxElements &&
+           !elementAdmin(key_store, index)->isFree &&
+           !isLive(key_store, index))
+    {
+        index = elementAdmin(key_store, index)->appNext;
+    }
+
+    // the keys in the elements are followed by those in the read only segment
+    if (index >= key_store->maxElements)
+    {
+        index = nextSegmentKey(key_store, iterator->appId, index);
+    }
+
+    iterator->index = index;
+
+    // the following element is gone if more than the current key was deleted
+    if (segmentEnd(key_store) == index ||
+        (index < key_store->maxElements &&
+         (elementAdmin(key_store, index)->isFree ||
+          iterator->appId != elementAdmin(key_store, index)->appId)))
+    {
+        iterator->index = segmentEnd(key_store);
+        iterator->next = segmentEnd(key_store);
+        return KeystoreRamFV_ERR_NOT_FOUND;
+    }
+
+    if (index >= key_store->maxElements)
+    {
+        iterator->next = index + 1;
+        copyBytes(
+            key_store,
+            iterator->name,
+            segmentKey(key_store, index)->name,
+            KeystoreRamFV_KEY_NAME_SIZE);
+    }
+    else
+    {
+        iterator->next = elementAdmin(key_store, index)->appNext;
+        copyBytes(
+            key_store,
+            iterator->name,
+            elementName(key_store, index),
+            KeystoreRamFV_KEY_NAME_SIZE);
+    }
+
+    if (key != NULL)
+    {
+        copyElementKey(key_store, index, key, KeystoreRamFV_KEY_DATA_SIZE);
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+static unsigned int
+startIteration(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    if (iterator == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    iterator->appId = appId;
+
+    return iterateTo(key_store, iterator, key_store->appHead[appId], key);
+}
+
+unsigned int
+KeystoreRamFV_first(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = startIteration(key_store, appId, iterator, key);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ITERATE);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_ITERATE, result);
+    return result;
+}
+
+static unsigned int
+continueIteration(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    if (iterator == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (iterator->appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    return iterateTo(key_store, iterator, iterator->next, key);
+}
+
+unsigned int
+KeystoreRamFV_next(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = continueIteration(key_store, iterator, key);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ITERATE);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_ITERATE, result);
+    return result;
+}
+
+static KeystoreRamFV_Result_t
+borrowKey(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyView_t *view)
+{
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+
+    if (name == NULL)
+    {
+        return result;
+    }
+
+    if (view == NULL)
+    {
+        return result;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return result;
+    }
+
+    result.index = findElement(key_store, key_store->maxElements, appId, name);
+
+    if (key_store->maxElements == result.index)
+    {
+        result.error = KeystoreRamFV_ERR_NOT_FOUND;
+        return result;
+    }
+
+    if (result.index > key_store->maxElements)
+    {
+        view->index = result.index;
+        view->generation = 0;
+        view->readOnly = 1;
+        view->dataSize = KeystoreRamFV_KEY_DATA_SIZE;
+        view->name = segmentKey(key_store, result.index)->name;
+        view->data = segmentKey(key_store, result.index)->data;
+
+        result.error = KeystoreRamFV_ERR_NONE;
+        return result;
+    }
+
+    countHit(key_store, result.index);
+    view->index = result.index;
+    view->generation = elementAdmin(key_store, result.index)->generation;
+    view->readOnly = *elementReadOnly(key_store, result.index);
+    view->dataSize = elementAdmin(key_store, result.index)->dataSize;
+    view->name = elementName(key_store, result.index);
+    view->data = elementData(key_store, result.index);
+
+    result.error = KeystoreRamFV_ERR_NONE;
+    return result;
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_borrow(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyView_t *view)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    KeystoreRamFV_Result_t result = borrowKey(key_store, appId, name, view);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_BORROW);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_BORROW, result.error);
+    return result;
+}
+
+unsigned int
+KeystoreRamFV_isViewValid(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_KeyView_t const *view)
+{
+    if (view == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (view->index >= segmentEnd(key_store))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (view->index == key_store->maxElements)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    // keys in the read only segment never change
+    if (view->index > key_store->maxElements)
+    {
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    if (view->index >= key_store->highWater ||
+        !isLive(key_store, view->index) ||
+        elementAdmin(key_store, view->index)->generation != view->generation)
+    {
+        return KeystoreRamFV_ERR_NOT_FOUND;
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+static unsigned int
+deleteKey(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    if (name == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    unsigned long element_index =
+        findElement(key_store, key_store->maxElements, appId, name);
+
+    if (key_store->maxElements == element_index)
+    {
+        return KeystoreRamFV_ERR_NOT_FOUND;
+    }
+
+    if (element_index > key_store->maxElements ||
+        *elementReadOnly(key_store, element_index))
+    {
+        return KeystoreRamFV_ERR_READ_ONLY;
+    }
+
+    deleteElement(key_store, element_index);
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+unsigned int
+KeystoreRamFV_delete(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = deleteKey(key_store, appId, name);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_DELETE);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_DELETE, result);
+    return result;
+}
+
+static unsigned int
+deleteIndex(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    unsigned long index)
+{
+    unsigned int result = checkElementIndex(key_store, appId, index);
+
+    if (KeystoreRamFV_ERR_NONE != result)
+    {
+        return result;
+    }
+
+    if (index > key_store->maxElements ||
+        *elementReadOnly(key_store, index))
+    {
+        return KeystoreRamFV_ERR_READ_ONLY;
+    }
+
+    deleteElement(key_store, index);
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+unsigned int
+KeystoreRamFV_deleteByIndex(
+    KeystoreRamFV_t *key_store,
+    unsigned int appId,
+    unsigned long index)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = deleteIndex(key_store, appId, index);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_DELETE);
+    KeystoreRamFV_COUNT_CALL(key_store, KeystoreRamFV_OP_DELETE, result);
+    return result;
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_find(
+    KeystoreRamFV_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+
+    if (name == NULL)
+    {
+        return result;
+    }
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return result;
+    }
+
+    result.index = findElement(key_store, key_store->maxElements, appId, name);
+    result.error = (key_store->maxElements == result.index) ?
+                   KeystoreRamFV_ERR_NOT_FOUND : KeystoreRamFV_ERR_NONE;
+    return result;
+}
+
+static unsigned int
+getKeys(
+    KeystoreRamFV_t const *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *keys,
+    KeystoreRamFV_Result_t *results)
+{
+    if (appIds == NULL || names == NULL || keys == NULL || results == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        results[i].error = (appIds[i] > KeystoreRamFV_MAX_APP_ID) ?
+                           KeystoreRamFV_ERR_INVALID_PARAMETER :
+                           KeystoreRamFV_ERR_NONE;
+    }
+
+    findElements(
+        key_store,
+        nr_keys,
+        appIds,
+        names[0],
+        KeystoreRamFV_KEY_NAME_SIZE,
+        results,
+        0);
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        if (KeystoreRamFV_ERR_NONE != results[i].error)
+        {
+            continue;
+        }
+
+        if (key_store->maxElements == results[i].index)
+        {
+            results[i].error = KeystoreRamFV_ERR_NOT_FOUND;
+            continue;
+        }
+
+        copyElementKey(
+            key_store,
+            results[i].index,
+            &keys[i],
+            KeystoreRamFV_KEY_DATA_SIZE);
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+unsigned int
+KeystoreRamFV_getBatch(
+    KeystoreRamFV_t const *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *keys,
+    KeystoreRamFV_Result_t *results)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = getKeys(key_store, nr_keys, appIds, names, keys, results);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_GET_BATCH);
+    KeystoreRamFV_COUNT_BATCH(key_store, KeystoreRamFV_OP_GET_BATCH, result, results, nr_keys);
+    return result;
+}
+
+static unsigned int
+addKeys(
+    KeystoreRamFV_t *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    KeystoreRamFV_Result_t *results)
+{
+    if (appIds == NULL || keys == NULL || results == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        results[i].error = (appIds[i] > KeystoreRamFV_MAX_APP_ID) ?
+                           KeystoreRamFV_ERR_INVALID_PARAMETER :
+                           KeystoreRamFV_ERR_NONE;
+    }
+
+    // the lowest free element only grows while adding, so without a free
+    // map the search for it continues where the previous one stopped
+    unsigned long next_free = 0;
+
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        // a window is added before the next one is looked for, so that keys
+        // equal to ones added already are found in the store
+        if (0 == i % KeystoreRamFV_BATCH_WINDOW)
+        {
+            findElements(
+                key_store,
+                (nr_keys - i < KeystoreRamFV_BATCH_WINDOW) ?
+                nr_keys - i : KeystoreRamFV_BATCH_WINDOW,
+                appIds + i,
+                keys[i].name,
+                sizeof(KeystoreRamFV_KeyRecord_t),
+                results + i,
+                1);
+        }
+
+        if (KeystoreRamFV_ERR_NONE != results[i].error)
+        {
+            results[i].index = key_store->maxElements;
+            continue;
+        }
+
+        if (0 == key_store->freeSlots)
+        {
+            results[i].error = KeystoreRamFV_ERR_OUT_OF_SPACE;
+            results[i].index = key_store->maxElements;
+            continue;
+        }
+
+        // also a key equal to an earlier one of the batch
+        if (key_store->maxElements != results[i].index)
+        {
+            results[i].error = KeystoreRamFV_ERR_DUPLICATED;
+            results[i].index = key_store->maxElements;
+            continue;
+        }
+
+        if (key_store->freeMap != NULL)
+        {
+            next_free = findFreeElement(key_store);
+        }
+        else
+        {
+            while (next_free < key_store->highWater &&
+                   isLive(key_store, next_free))
+            {
+                next_free++;
+            }
 
-        key_store->elementStore[index].admin.isFree = 1;
-        key_store->elementStore[index].admin.appId = 0;
+            if (next_free == key_store->highWater)
+            {
+                extendHighWater(key_store);
+            }
+            else
+            {
+                claimElement(key_store, next_free);
+            }
+        }
 
-        resetElementKey(key_store, index);
+        results[i].index = next_free;
+        key_store->freeSlots -= 1;
+        occupyElement(
+            key_store,
+            next_free,
+            appIds[i],
+            0,
+            &keys[i],
+            KeystoreRamFV_KEY_DATA_SIZE);
     }
+
+    return KeystoreRamFV_ERR_NONE;
 }
 
+unsigned int
+KeystoreRamFV_addBatch(
+    KeystoreRamFV_t *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    KeystoreRamFV_Result_t *results)
+{
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = addKeys(key_store, nr_keys, appIds, keys, results);
 
-static unsigned long
-findElement(
-    KeystoreRamFV_t const *key_store,
-    unsigned long max,
-    const unsigned int appId,
-    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_ADD_BATCH);
+    KeystoreRamFV_COUNT_BATCH(key_store, KeystoreRamFV_OP_ADD_BATCH, result, results, nr_keys);
+    return result;
+}
+
+static unsigned int
+deleteKeys(
+    KeystoreRamFV_t *key_store,
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_Result_t *results)
 {
-    if (name == NULL)
+    if (appIds == NULL || names == NULL || results == NULL)
     {
-        return max;
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
     }
 
-    if (max > key_store->maxElements)
+    for (unsigned long i = 0; i < nr_keys; i++)
     {
-        max = key_store->maxElements;
+        results[i].error = (appIds[i] > KeystoreRamFV_MAX_APP_ID) ?
+                           KeystoreRamFV_ERR_INVALID_PARAMETER :
+                           KeystoreRamFV_ERR_NONE;
     }
 
-    for (unsigned long k = 0; k < max; k++)
+    findElements(
+        key_store,
+        nr_keys,
+        appIds,
+        names[0],
+        KeystoreRamFV_KEY_NAME_SIZE,
+        results,
+        0);
+
+    for (unsigned long i = 0; i < nr_keys; i++)
     {
-        if (!key_store->elementStore[k].admin.isFree)
+        if (KeystoreRamFV_ERR_NONE != results[i].error)
         {
-            if (appId == key_store->elementStore[k].admin.appId &&
-                0 == memcmp_fv(
-                        name,
-                        (void *) key_store->elementStore[k].key.name,
-                        KeystoreRamFV_KEY_NAME_SIZE))
-            {
-                return k;
-            }
+            continue;
         }
-    }
 
-    return max;
-}
+        // a key listed twice is gone by the time of its second entry
+        if (key_store->maxElements == results[i].index ||
+            (results[i].index < key_store->maxElements &&
+             !isLive(key_store, results[i].index)))
+        {
+            results[i].error = KeystoreRamFV_ERR_NOT_FOUND;
+            results[i].index = key_store->maxElements;
+            continue;
+        }
 
-static unsigned long
-findFreeElement(KeystoreRamFV_t const *key_store)
-{
-    for (unsigned long k = 0; k < key_store->maxElements; k++)
-    {
-        if (key_store->elementStore[k].admin.isFree)
+        if (results[i].index > key_store->maxElements ||
+            *elementReadOnly(key_store, results[i].index))
         {
-            return k;
+            results[i].error = KeystoreRamFV_ERR_READ_ONLY;
+            continue;
         }
+
+        deleteElement(key_store, results[i].index);
     }
 
-    return key_store->maxElements;
+    return KeystoreRamFV_ERR_NONE;
 }
 
-void
-KeystoreRamFV_init(
+unsigned int
+KeystoreRamFV_deleteBatch(
     KeystoreRamFV_t *key_store,
-    unsigned long maxElements,
-    KeystoreRamFV_ElementRecord_t *elementStore)
+    unsigned long nr_keys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_Result_t *results)
 {
-    key_store->maxElements = maxElements;
-    key_store->elementStore = elementStore;
-    key_store->freeSlots = key_store->maxElements;
-    for (unsigned long k = 0; k < key_store->maxElements; k++)
+    KeystoreRamFV_TIME_START(key_store->timing);
+    unsigned int result = deleteKeys(key_store, nr_keys, appIds, names, results);
+
+    KeystoreRamFV_TIME_STOP(key_store->timing, KeystoreRamFV_OP_DELETE_BATCH);
+    KeystoreRamFV_COUNT_BATCH(key_store, KeystoreRamFV_OP_DELETE_BATCH, result, results, nr_keys);
+    return result;
+}
+
+// The sizes of the parts of a snapshot, see KeystoreRamFV.h.
+#define KeystoreRamFV_SNAPSHOT_HEADER_SIZE     16
+#define KeystoreRamFV_SNAPSHOT_KEY_HEADER_SIZE 6
+#define KeystoreRamFV_SNAPSHOT_TRAILER_SIZE    4
+
+typedef struct SnapshotStream {
+    KeystoreRamFV_Writer_t write;
+    KeystoreRamFV_Reader_t read;
+    void *context;
+    unsigned long checksum; /* of all bytes so far */
+} SnapshotStream_t;
+
+static void
+encodeNumber(unsigned char *bytes, unsigned long number, unsigned int size)
+{
+    for (unsigned int k = 0; k < size; k++)
     {
-        key_store->elementStore[k].admin.isFree = 1;
-        key_store->elementStore[k].admin.appId = 0;
-        resetElementKey(key_store, k);
+        bytes[k] = (unsigned char) (number >> (8 * k));
     }
 }
 
-unsigned int
-KeystoreRamFV_initWithReadOnlyKeys(
-    KeystoreRamFV_t *key_store,
-    unsigned int const *appIds,
-    KeystoreRamFV_KeyRecord_t const *keys,
-    unsigned long nr_keys,
-    unsigned long maxElements,
-    KeystoreRamFV_ElementRecord_t *elementStore)
+static unsigned long
+decodeNumber(unsigned char const *bytes, unsigned int size)
 {
-    unsigned int result = KeystoreRamFV_ERR_NONE;
+    unsigned long number = 0;
 
-    key_store->maxElements = maxElements;
-    key_store->elementStore = elementStore;
-
-    if (nr_keys > key_store->maxElements)
+    for (unsigned int k = 0; k < size; k++)
     {
-        nr_keys = 0;
-        result = -1;
+        number |= (unsigned long) bytes[k] << (8 * k);
     }
 
-    for (unsigned long k = 0; k < nr_keys; k++)
-    {
-        // if there is a duplicate, return an empty keystore
-        if (findElement(key_store, k, appIds[k], keys[k].name) < k)
-        {
-            nr_keys = 0;
-            result = KeystoreRamFV_ERR_DUPLICATED;
-            break;
-        }
+    return number;
+}
 
-        key_store->elementStore[k].admin.isFree = 0;
-        key_store->elementStore[k].admin.appId = appIds[k];
-        key_store->elementStore[k].key.readOnly = 1;
-        memcpy_fv(
-            key_store->elementStore[k].key.name,
-            keys[k].name,
-            KeystoreRamFV_KEY_NAME_SIZE);
-        memcpy_fv(
-            key_store->elementStore[k].key.data,
-            keys[k].data,
-            KeystoreRamFV_KEY_DATA_SIZE);
+static void
+updateChecksum(
+    SnapshotStream_t *stream,
+    unsigned char const *bytes,
+    unsigned long size)
+{
+    // 32 bit FNV-1a, as for the hash of the keys
+    for (unsigned long k = 0; k < size; k++)
+    {
+        stream->checksum = ((stream->checksum ^ bytes[k]) * 16777619UL) & 0xffffffffUL;
     }
+}
+
+static unsigned int
+writeSnapshot(SnapshotStream_t *stream, void const *bytes, unsigned long size)
+{
+    updateChecksum(stream, (unsigned char const *) bytes, size);
+    return stream->write(stream->context, bytes, size);
+}
+
+static unsigned int
+readSnapshot(SnapshotStream_t *stream, void *bytes, unsigned long size)
+{
+    unsigned int result = stream->read(stream->context, bytes, size);
 
-    for (unsigned long k = nr_keys; k < key_store->maxElements; k++)
+    if (KeystoreRamFV_ERR_NONE == result)
     {
-        key_store->elementStore[k].admin.isFree = 1;
-        key_store->elementStore[k].admin.appId = 0;
-        key_store->elementStore[k].key.readOnly = 0;
-        resetElementKey(key_store, k);
+        updateChecksum(stream, (unsigned char const *) bytes, size);
     }
 
-    key_store->freeSlots = key_store->maxElements - nr_keys;
     return result;
 }
 
-
-void
-KeystoreRamFV_wipe(KeystoreRamFV_t *key_store)
+unsigned int
+KeystoreRamFV_export(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Writer_t write,
+    void *context)
 {
-    for (unsigned long k = 0; k < key_store->maxElements; k++)
+    SnapshotStream_t stream = {write, NULL, context, 2166136261UL};
+    unsigned char header[KeystoreRamFV_SNAPSHOT_HEADER_SIZE] = {'K', 'R', 'F', 'V'};
+    unsigned int result;
+
+    if (write == NULL)
     {
-        if (!key_store->elementStore[k].admin.isFree &&
-            !key_store->elementStore[k].key.readOnly)
-        {
-            deleteElement(key_store, k);
-        }
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
     }
-}
 
+    encodeNumber(&header[4], KeystoreRamFV_SNAPSHOT_VERSION, 2);
+    encodeNumber(&header[6], KeystoreRamFV_KEY_NAME_SIZE, 2);
+    encodeNumber(&header[8], KeystoreRamFV_KEY_DATA_SIZE, 4);
+    // stale elements are counted as free
+    encodeNumber(&header[12], key_store->maxElements - key_store->freeSlots, 4);
 
-KeystoreRamFV_Result_t
-KeystoreRamFV_add(
-    KeystoreRamFV_t *key_store,
-    unsigned int appId,
-    KeystoreRamFV_KeyRecord_t const *key)
-{
-    KeystoreRamFV_Result_t result =
-        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+    result = writeSnapshot(&stream, header, KeystoreRamFV_SNAPSHOT_HEADER_SIZE);
 
-    if (key == NULL)
+    for (unsigned long k = 0; k < key_store->highWater && KeystoreRamFV_ERR_NONE == result; k++)
     {
-        return result;
+        unsigned char key_header[KeystoreRamFV_SNAPSHOT_KEY_HEADER_SIZE];
+        unsigned long data_size = elementAdmin(key_store, k)->dataSize;
+
+        if (!isLive(key_store, k))
+        {
+            continue;
+        }
+
+        encodeNumber(&key_header[0], elementAdmin(key_store, k)->appId, 1);
+        encodeNumber(&key_header[1], *elementReadOnly(key_store, k), 1);
+        encodeNumber(&key_header[2], data_size, 4);
+
+        result = writeSnapshot(&stream, key_header, KeystoreRamFV_SNAPSHOT_KEY_HEADER_SIZE);
+        if (KeystoreRamFV_ERR_NONE == result)
+        {
+            result = writeSnapshot(
+                         &stream,
+                         elementName(key_store, k),
+                         KeystoreRamFV_KEY_NAME_SIZE);
+        }
+        if (KeystoreRamFV_ERR_NONE == result && data_size > 0)
+        {
+            result = writeSnapshot(&stream, elementData(key_store, k), data_size);
+        }
     }
 
-    if (appId > KeystoreRamFV_MAX_APP_ID)
+    if (KeystoreRamFV_ERR_NONE == result)
     {
-        return result;
+        unsigned char trailer[KeystoreRamFV_SNAPSHOT_TRAILER_SIZE];
+
+        encodeNumber(trailer, stream.checksum, KeystoreRamFV_SNAPSHOT_TRAILER_SIZE);
+        result = stream.write(stream.context, trailer, KeystoreRamFV_SNAPSHOT_TRAILER_SIZE);
     }
 
-    if (0 == key_store->freeSlots)
+    return result;
+}
+
+// Reads the keys of the snapshot straight into the elements of the freshly
+// initialized store, one after the other from the first element on.
+static unsigned int
+importKeys(KeystoreRamFV_t *key_store, SnapshotStream_t *stream)
+{
+    unsigned char header[KeystoreRamFV_SNAPSHOT_HEADER_SIZE];
+    unsigned char trailer[KeystoreRamFV_SNAPSHOT_TRAILER_SIZE];
+    unsigned int result = readSnapshot(stream, header, KeystoreRamFV_SNAPSHOT_HEADER_SIZE);
+
+    if (KeystoreRamFV_ERR_NONE != result)
     {
-        result.error = KeystoreRamFV_ERR_OUT_OF_SPACE;
         return result;
     }
 
-    if (key_store->maxElements >
-            findElement(key_store, key_store->maxElements, appId, key->name))
+    if (header[0] != 'K' || header[1] != 'R' || header[2] != 'F' || header[3] != 'V' ||
+        KeystoreRamFV_SNAPSHOT_VERSION != decodeNumber(&header[4], 2) ||
+        KeystoreRamFV_KEY_NAME_SIZE != decodeNumber(&header[6], 2))
     {
-        result.error = KeystoreRamFV_ERR_DUPLICATED;
-        return result;
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
     }
 
-    result.index = findFreeElement(key_store);
+    unsigned long nr_keys = decodeNumber(&header[12], 4);
 
-    if (key_store->maxElements == result.index)
+    if (nr_keys > key_store->freeSlots)
     {
-        result.error = KeystoreRamFV_ERR_OUT_OF_SPACE;
-        return result;
+        return KeystoreRamFV_ERR_OUT_OF_SPACE;
     }
 
-    key_store->freeSlots -= 1;
+    for (unsigned long i = 0; i < nr_keys; i++)
+    {
+        unsigned char key_header[KeystoreRamFV_SNAPSHOT_KEY_HEADER_SIZE];
 
-    key_store->elementStore[result.index].admin.isFree = 0;
-    key_store->elementStore[result.index].admin.appId = appId;
+        result = readSnapshot(stream, key_header, KeystoreRamFV_SNAPSHOT_KEY_HEADER_SIZE);
+        if (KeystoreRamFV_ERR_NONE != result)
+        {
+            return result;
+        }
 
-    key_store->elementStore[result.index].key.readOnly = 0;
-    memcpy_fv(
-        key_store->elementStore[result.index].key.name,
-        key->name,
-        KeystoreRamFV_KEY_NAME_SIZE);
-    memcpy_fv(
-        key_store->elementStore[result.index].key.data,
-        key->data,
-        KeystoreRamFV_KEY_DATA_SIZE);
+        unsigned int app_id = (unsigned int) decodeNumber(&key_header[0], 1);
+        unsigned int read_only = (unsigned int) decodeNumber(&key_header[1], 1);
+        unsigned long data_size = decodeNumber(&key_header[2], 4);
 
-    result.error = KeystoreRamFV_ERR_NONE;
-    return result;
-}
+        if (app_id > KeystoreRamFV_MAX_APP_ID || read_only > 1 ||
+            data_size > KeystoreRamFV_KEY_DATA_SIZE)
+        {
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
 
+        unsigned long index = extendHighWater(key_store);
 
-KeystoreRamFV_Result_t
-KeystoreRamFV_get(
-    KeystoreRamFV_t const *key_store,
-    unsigned int appId,
-    const char name [KeystoreRamFV_KEY_NAME_SIZE],
-    KeystoreRamFV_KeyRecord_t *key)
-{
-    KeystoreRamFV_Result_t result =
-        {KeystoreRamFV_ERR_INVALID_PARAMETER, key_store->maxElements};
+        result = readSnapshot(stream, elementName(key_store, index), KeystoreRamFV_KEY_NAME_SIZE);
+        if (KeystoreRamFV_ERR_NONE != result)
+        {
+            return result;
+        }
 
-    if (name == NULL)
-    {
-        return result;
-    }
+        // the element is not live yet, so only another one can hold the key
+        if (key_store->maxElements !=
+                findElement(key_store, key_store->maxElements, app_id, elementName(key_store, index)))
+        {
+            return KeystoreRamFV_ERR_DUPLICATED;
+        }
 
-    if (key == NULL)
-    {
-        return result;
-    }
+        if (data_size > 0)
+        {
+            result = readSnapshot(stream, elementData(key_store, index), data_size);
+            if (KeystoreRamFV_ERR_NONE != result)
+            {
+                return result;
+            }
+        }
 
-    if (appId > KeystoreRamFV_MAX_APP_ID)
-    {
-        return result;
+        admitElement(key_store, index, app_id, read_only, data_size);
+        key_store->freeSlots -= 1;
+        key_store->readOnlySlots += read_only;
     }
 
-    result.index = findElement(key_store, key_store->maxElements, appId, name);
+    unsigned long checksum = stream->checksum;
 
-    if (key_store->maxElements == result.index)
+    result = stream->read(stream->context, trailer, KeystoreRamFV_SNAPSHOT_TRAILER_SIZE);
+    if (KeystoreRamFV_ERR_NONE != result)
     {
-        result.error = KeystoreRamFV_ERR_NOT_FOUND;
         return result;
     }
 
-    memcpy_fv(
-        key->name,
-        key_store->elementStore[result.index].key.name,
-        KeystoreRamFV_KEY_NAME_SIZE);
-    memcpy_fv(
-        key->data,
-        key_store->elementStore[result.index].key.data,
-        KeystoreRamFV_KEY_DATA_SIZE);
-    key->readOnly = key_store->elementStore[result.index].key.readOnly;
-
-    result.error = KeystoreRamFV_ERR_NONE;
-    return result;
+    return (checksum == decodeNumber(trailer, KeystoreRamFV_SNAPSHOT_TRAILER_SIZE)) ?
+           KeystoreRamFV_ERR_NONE : KeystoreRamFV_ERR_GENERIC;
 }
 
 unsigned int
-KeystoreRamFV_getByIndex(
-    KeystoreRamFV_t const *key_store,
-    unsigned int appId,
-    unsigned long index,
-    KeystoreRamFV_KeyRecord_t *key)
+KeystoreRamFV_import(
+    KeystoreRamFV_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    KeystoreRamFV_Reader_t read,
+    void *context)
 {
-    if (key == NULL)
-    {
-        return KeystoreRamFV_ERR_INVALID_PARAMETER;
-    }
+    SnapshotStream_t stream = {NULL, read, context, 2166136261UL};
 
-    if (index >= key_store->maxElements)
+    if (read == NULL)
     {
         return KeystoreRamFV_ERR_INVALID_PARAMETER;
     }
 
-    if (appId > KeystoreRamFV_MAX_APP_ID)
-    {
-        return KeystoreRamFV_ERR_INVALID_PARAMETER;
-    }
+    unsigned int result = KeystoreRamFV_initWithConfig(key_store, config, NULL, NULL, 0);
 
-    if (key_store->elementStore[index].admin.isFree)
+    if (KeystoreRamFV_ERR_NONE != result)
     {
-        return KeystoreRamFV_ERR_NOT_FOUND;
+        return result;
     }
 
-    if (appId != key_store->elementStore[index].admin.appId)
+    result = importKeys(key_store, &stream);
+
+    if (KeystoreRamFV_ERR_NONE != result)
     {
-        return KeystoreRamFV_ERR_INVALID_PARAMETER;
-    }
+        // also zeroes the keys read so far, even with lazy initialization
+        KeystoreRamFV_Config_t eager_config = *config;
 
-    memcpy_fv(
-        key->name,
-        key_store->elementStore[index].key.name,
-        KeystoreRamFV_KEY_NAME_SIZE);
-    memcpy_fv(
-        key->data,
-        key_store->elementStore[index].key.data,
-        KeystoreRamFV_KEY_DATA_SIZE);
-    key->readOnly = key_store->elementStore[index].key.readOnly;
+        eager_config.lazyInit = 0;
+        initStore(key_store, &eager_config, NULL, NULL, 0);
+    }
 
-    return KeystoreRamFV_ERR_NONE;
+    return result;
 }
 
-unsigned int
-KeystoreRamFV_delete(
-    KeystoreRamFV_t *key_store,
-    unsigned int appId,
-    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+#if defined(KeystoreRamFV_STATISTICS)
+void
+KeystoreRamFV_getStatistics(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Statistics_t *snapshot)
 {
-    if (name == NULL)
+    if (key_store->statistics == NULL)
     {
-        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        memset_fv(snapshot, 0, sizeof(*snapshot));
+        return;
     }
 
-    if (appId > KeystoreRamFV_MAX_APP_ID)
+    memcpy_fv(snapshot, key_store->statistics, sizeof(*snapshot));
+}
+
+void
+KeystoreRamFV_resetStatistics(KeystoreRamFV_t const *key_store)
+{
+    if (key_store->statistics != NULL)
     {
-        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        memset_fv(key_store->statistics, 0, sizeof(*key_store->statistics));
     }
+}
+#endif
 
-    unsigned long element_index =
-        findElement(key_store, key_store->maxElements, appId, name);
+#if defined(KeystoreRamFV_TIMING)
+void
+KeystoreRamFV_getLatencies(
+    KeystoreRamFV_t const *key_store,
+    KeystoreRamFV_Latency_t latencies[KeystoreRamFV_NR_OPS])
+{
+    memset_fv(latencies, 0, KeystoreRamFV_NR_OPS * sizeof(*latencies));
 
-    if (key_store->maxElements == element_index)
+    if (key_store->timing == NULL)
     {
-        return KeystoreRamFV_ERR_NOT_FOUND;
+        return;
     }
 
-    if (key_store->elementStore[element_index].key.readOnly)
+    for (unsigned int op = 0; op < KeystoreRamFV_NR_OPS; op++)
     {
-        return KeystoreRamFV_ERR_READ_ONLY;
-    }
+        KeystoreRamFV_Histogram_t const *histogram = &key_store->timing->histograms[op];
 
-    deleteElement(key_store, element_index);
+        latencies[op].count = histogram->count;
+        latencies[op].p50 = histogramPercentile(histogram, 500);
+        latencies[op].p99 = histogramPercentile(histogram, 990);
+        latencies[op].p999 = histogramPercentile(histogram, 999);
+        latencies[op].max = histogram->max;
+    }
+}
 
-    return KeystoreRamFV_ERR_NONE;
+void
+KeystoreRamFV_resetLatencies(KeystoreRamFV_t const *key_store)
+{
+    if (key_store->timing != NULL)
+    {
+        memset_fv(
+            key_store->timing->histograms,
+            0,
+            sizeof(key_store->timing->histograms));
+    }
 }
+#endif
 
 #ifdef __cplusplus
 }
@@ -37,9 +37,30 @@ typedef struct KeystoreRamFV_KeyRecord {
 } KeystoreRamFV_KeyRecord_t;
 
 
+/**
+ * The layout of an element, which is part of the interface: callers allocate
+ * the elements as an array of KeystoreRamFV_ElementRecord_t, and files and
+ * attached memory keep them as they are. Version 1 was an admin header of
+ * isFree and appId only; version 2 adds the fields after appId, which makes
+ * the header and so sizeof(KeystoreRamFV_ElementRecord_t) and
+ * sizeof(KeystoreRamFV_t) larger. The fixed size functions keep their
+ * signatures, so callers build unchanged, but are not binary compatible with
+ * version 1: code built against another header allocates elements of the
+ * wrong size. It finds out with KeystoreRamFV_getLayoutVersion(), which gives
+ * the version the library was built with, and memory of elements of another
+ * version can not be attached, so callers that store elements keep the
+ * version with them.
+ */
+#define KeystoreRamFV_LAYOUT_VERSION 2
+
 typedef struct KeystoreRamFV_ElementAdmin {
     unsigned int isFree;
     unsigned int appId;
+    unsigned int dataSize; /* bytes of data in use, all beyond are zero */
+    unsigned long generation; /* changes whenever the element is freed */
+    unsigned long epoch;      /* of the store when the element was occupied */
+    unsigned long appNext; /* list of the elements of appId, ends with maxElements */
+    unsigned long appPrev;
 } KeystoreRamFV_ElementAdmin_t;
 
 
@@ -49,17 +70,313 @@ typedef struct KeystoreRamFV_ElementRecord {
 } KeystoreRamFV_ElementRecord_t;
 
 
+/**
+ * The optional hash index over (appId, name) is an open addressing table with
+ * linear probing. Its entries are provided by the caller, at least
+ * KeystoreRamFV_INDEX_SIZE(maxElements) of them, which keeps the load factor
+ * at or below 1/2. The last entry is not part of the table but keeps the
+ * generation of its entries, which a lazy initialization just increments
+ * instead of clearing the table, so the entries of earlier generations count
+ * as unused. For that, the memory of the index has to hold zeros or an index
+ * of an earlier initialization when it is initialized lazily.
+ */
+#define KeystoreRamFV_INDEX_SIZE(maxElements) (2 * (maxElements) + 2)
+
+typedef struct KeystoreRamFV_IndexEntry {
+    unsigned long hash;
+    unsigned long element; /* element index + 1, 0 if the entry is unused */
+    unsigned long generation; /* of the index when the entry was written */
+} KeystoreRamFV_IndexEntry_t;
+
+
+/**
+ * The optional free map is a bitmap with one bit per element, set if the
+ * element is free. It is provided by the caller as an array of
+ * KeystoreRamFV_FREE_MAP_SIZE(maxElements) words.
+ */
+#define KeystoreRamFV_FREE_MAP_BITS (8 * sizeof(unsigned long))
+#define KeystoreRamFV_FREE_MAP_SIZE(maxElements) \
+    (((maxElements) + KeystoreRamFV_FREE_MAP_BITS - 1) / KeystoreRamFV_FREE_MAP_BITS)
+
+
+/**
+ * Instead of an array of KeystoreRamFV_ElementRecord_t, the elements can be
+ * held in a split store, where the admin headers, the read only flags, the
+ * names and the data of all elements are kept in separate arrays. Scans then
+ * only touch the dense admin headers and the data is touched only when it is
+ * copied. The split store is a single caller-provided buffer of
+ * KeystoreRamFV_SPLIT_STORE_SIZE(maxElements) bytes, aligned at least like
+ * KeystoreRamFV_ElementAdmin_t. Each array starts on a cache line.
+ */
+#define KeystoreRamFV_SPLIT_STORE_ALIGN 64
+#define KeystoreRamFV_SPLIT_STORE_ALIGN_UP(size) \
+    (((size) + KeystoreRamFV_SPLIT_STORE_ALIGN - 1) & \
+     ~((unsigned long) KeystoreRamFV_SPLIT_STORE_ALIGN - 1))
+#define KeystoreRamFV_SPLIT_STORE_SIZE(maxElements) \
+    (KeystoreRamFV_SPLIT_STORE_ALIGN_UP((maxElements) * sizeof(KeystoreRamFV_ElementAdmin_t)) + \
+     KeystoreRamFV_SPLIT_STORE_ALIGN_UP((maxElements) * sizeof(unsigned int)) + \
+     KeystoreRamFV_SPLIT_STORE_ALIGN_UP((maxElements) * KeystoreRamFV_KEY_NAME_SIZE) + \
+     (maxElements) * KeystoreRamFV_KEY_DATA_SIZE)
+
+/**
+ * The optional read only segment holds keys that are fixed at build time. It
+ * lives in constant memory outside of the elements, so its keys take no
+ * element and are not copied at init. They are found in O(1) with a perfect
+ * hash: the hash of the index selects a bucket, and the seed of the bucket
+ * selects the slot of the table that holds the position of the key. The
+ * segment is generated at compile time by KeystoreRamFVSegment.hpp. Its keys
+ * are read only, with maxElements + 1 plus their position as index.
+ */
+typedef struct KeystoreRamFV_SegmentKey {
+    unsigned int appId;
+    KeystoreRamFV_KeyRecord_t key;
+} KeystoreRamFV_SegmentKey_t;
+
+typedef struct KeystoreRamFV_ReadOnlySegment {
+    unsigned long nrKeys;
+    KeystoreRamFV_SegmentKey_t const *keys;
+    unsigned long nrBuckets;
+    unsigned long const *seeds; /* one per bucket */
+    unsigned long tableSize;
+    unsigned long const *table; /* position of the key per slot, nrKeys if none */
+} KeystoreRamFV_ReadOnlySegment_t;
+
+#define KeystoreRamFV_SEGMENT_MIX(hash, seed) \
+    ((((hash) ^ (seed)) * 2654435761UL) & 0xffffffffUL)
+#define KeystoreRamFV_SEGMENT_SLOT(hash, seed, tableSize) \
+    ((KeystoreRamFV_SEGMENT_MIX(hash, seed) ^ \
+      (KeystoreRamFV_SEGMENT_MIX(hash, seed) >> 16)) % (tableSize))
+
+
+/**
+ * The optional fingerprints are one byte per element, provided by the caller
+ * as an array of KeystoreRamFV_FINGERPRINTS_SIZE(maxElements) bytes. The byte
+ * is 0 for a free element and otherwise holds 7 bits of the hash of the key,
+ * with the top bit set. A scan without an index compares them with the one of
+ * the key it looks for, many at a time, and looks at an element only if its
+ * fingerprint matches.
+ */
+#define KeystoreRamFV_FINGERPRINTS_SIZE(maxElements) (maxElements)
+
+/**
+ * The optional hit counters are one unsigned int per element, provided by the
+ * caller as an array of KeystoreRamFV_HIT_COUNTERS_SIZE(maxElements) of them.
+ * Each counts the lookups by name that found the key of its element, up to
+ * KeystoreRamFV_MAX_HITS, and KeystoreRamFV_adapt() uses them to move
+ * frequently used keys toward the start of the scan. They are written by get
+ * and borrow, so stores with hit counters must not have concurrent readers.
+ */
+#define KeystoreRamFV_HIT_COUNTERS_SIZE(maxElements) (maxElements)
+#define KeystoreRamFV_MAX_HITS 0xffffffffU
+
+/**
+ * The optional lookup cache sits in front of KeystoreRamFV_get() and
+ * _getWithSize() and remembers the elements of recently found keys, so
+ * repeated lookups of a key skip the index or the scan. It is set associative:
+ * the hash of (appId, name) selects one of nrSets sets of
+ * KeystoreRamFV_CACHE_WAYS entries, whose oldest entry makes room for a new
+ * one. The entries are provided by the caller, nrSets *
+ * KeystoreRamFV_CACHE_WAYS of them. A remembered element is used only if its
+ * generation, which changes whenever the element is freed, is the remembered
+ * one and it still holds the key, so a deleted or moved key is never returned;
+ * wipes and initialization clear the cache. hits and misses count the lookups
+ * answered by the cache and the others, and may be reset by the caller. As
+ * with the hit counters, stores with a lookup cache must not have concurrent
+ * readers.
+ */
+#define KeystoreRamFV_CACHE_WAYS 4
+
+typedef struct KeystoreRamFV_CacheEntry {
+    unsigned long hash;
+    unsigned long element;    /* element index + 1, 0 if the entry is unused */
+    unsigned long generation; /* of the element when the entry was made */
+} KeystoreRamFV_CacheEntry_t;
+
+typedef struct KeystoreRamFV_LookupCache {
+    unsigned long nrSets;
+    KeystoreRamFV_CacheEntry_t *entries;
+    unsigned long hits;
+    unsigned long misses;
+} KeystoreRamFV_LookupCache_t;
+
+
+/* the operations, as counted by the statistics and timed by the histograms */
+#define KeystoreRamFV_OP_INIT           0
+#define KeystoreRamFV_OP_WIPE           1  /* also deferred */
+#define KeystoreRamFV_OP_SCRUB          2
+#define KeystoreRamFV_OP_ADD            3
+#define KeystoreRamFV_OP_GET            4
+#define KeystoreRamFV_OP_GET_BY_INDEX   5
+#define KeystoreRamFV_OP_ITERATE        6  /* first and next */
+#define KeystoreRamFV_OP_BORROW         7
+#define KeystoreRamFV_OP_DELETE         8
+#define KeystoreRamFV_OP_GET_BATCH      9  /* errors per key */
+#define KeystoreRamFV_OP_ADD_BATCH      10 /* errors per key */
+#define KeystoreRamFV_OP_DELETE_BATCH   11 /* errors per key */
+#define KeystoreRamFV_OP_COMPACT        12
+#define KeystoreRamFV_OP_ADAPT          13
+#define KeystoreRamFV_NR_OPS            14
+
+
+#if defined(KeystoreRamFV_STATISTICS)
+/**
+ * Built with KeystoreRamFV_STATISTICS defined, a store counts what its
+ * operations do in the KeystoreRamFV_Statistics_t given with its
+ * configuration, if any. Without it, neither the counters nor the functions to
+ * read and reset them exist, and nothing is counted. The counters are plain
+ * words, so concurrent readers of a store must not share them.
+ */
+
+/* errors are tallied at 0 - error, KeystoreRamFV_ERR_NONE included */
+#define KeystoreRamFV_NR_ERRORS         7
+
+typedef struct KeystoreRamFV_Statistics {
+    unsigned long calls[KeystoreRamFV_NR_OPS];
+    unsigned long errors[KeystoreRamFV_NR_OPS][KeystoreRamFV_NR_ERRORS];
+    unsigned long slotsScanned; /* elements and index entries looked at */
+    unsigned long comparisons;  /* of names, by memcmp_fv or vector compares */
+    unsigned long bytesCopied;  /* with memcpy_fv */
+    unsigned long bytesZeroed;  /* with memset_fv */
+} KeystoreRamFV_Statistics_t;
+#endif
+
+
+#if defined(KeystoreRamFV_TIMING)
+/**
+ * Built with KeystoreRamFV_TIMING defined, a store records the latency of each
+ * call of its public functions in the KeystoreRamFV_Timing_t given with its
+ * configuration, if any, in one histogram per operation. Latencies are in ticks
+ * of the clock now(), or in ns of clock_gettime(CLOCK_MONOTONIC) if it is NULL.
+ * The histograms are log bucketed: each power of two is split into
+ * KeystoreRamFV_HISTOGRAM_SUB_BUCKETS buckets, so a latency is known to within
+ * 1/8 of its value. As with the statistics, nothing of this exists without the
+ * flag, and concurrent readers of a store must not share the histograms.
+ */
+#define KeystoreRamFV_HISTOGRAM_SUB_BITS    3
+#define KeystoreRamFV_HISTOGRAM_SUB_BUCKETS (1 << KeystoreRamFV_HISTOGRAM_SUB_BITS)
+#define KeystoreRamFV_HISTOGRAM_BUCKETS \
+    (KeystoreRamFV_HISTOGRAM_SUB_BUCKETS * \
+     (8 * sizeof(unsigned long) - KeystoreRamFV_HISTOGRAM_SUB_BITS + 1))
+
+typedef struct KeystoreRamFV_Histogram {
+    unsigned long count;
+    unsigned long max;
+    unsigned long buckets[KeystoreRamFV_HISTOGRAM_BUCKETS];
+} KeystoreRamFV_Histogram_t;
+
+typedef struct KeystoreRamFV_Timing {
+    unsigned long (*now)(void); /* NULL for clock_gettime() */
+    KeystoreRamFV_Histogram_t histograms[KeystoreRamFV_NR_OPS];
+} KeystoreRamFV_Timing_t;
+
+/* percentiles are the upper bounds of their buckets, but never above max */
+typedef struct KeystoreRamFV_Latency {
+    unsigned long count;
+    unsigned long p50;
+    unsigned long p99;
+    unsigned long p999;
+    unsigned long max;
+} KeystoreRamFV_Latency_t;
+#endif
+
+
+/* where the fields of element k are: base + k * stride */
+typedef struct KeystoreRamFV_Layout {
+    char *admin;
+    char *readOnly;
+    char *name;
+    char *data;
+    unsigned long adminStride;
+    unsigned long readOnlyStride;
+    unsigned long nameStride;
+    unsigned long dataStride;
+} KeystoreRamFV_Layout_t;
+
+
 typedef struct KeystoreRamFV {
     unsigned long freeSlots;
     unsigned long maxElements;
-    KeystoreRamFV_ElementRecord_t *elementStore;
+    KeystoreRamFV_ElementRecord_t *elementStore; /* NULL for a split store */
+    KeystoreRamFV_Layout_t layout;
+    unsigned long indexSize;
+    unsigned long indexMaxProbe;
+    unsigned long indexGeneration; /* of the entries in use */
+    KeystoreRamFV_IndexEntry_t *indexStore;
+    unsigned long freeMapHint; /* no free bit in the words below this one */
+    unsigned long *freeMap;
+    unsigned long appHead[KeystoreRamFV_MAX_APP_ID + 1];
+    unsigned long readOnlySlots;
+    unsigned long epoch;
+    unsigned long scrubCursor; /* no stale elements below this one */
+    unsigned long highWater;   /* all elements from here on are free */
+    unsigned long initializedElements; /* the ones from here on are not */
+    KeystoreRamFV_ReadOnlySegment_t const *readOnlySegment;
+    unsigned char *fingerprints;
+    unsigned int *hitCounters;
+    KeystoreRamFV_LookupCache_t *lookupCache;
+#if defined(KeystoreRamFV_STATISTICS)
+    KeystoreRamFV_Statistics_t *statistics;
+#endif
+#if defined(KeystoreRamFV_TIMING)
+    KeystoreRamFV_Timing_t *timing;
+#endif
 } KeystoreRamFV_t;
 
+typedef struct KeystoreRamFV_Config {
+    unsigned long maxElements;
+    KeystoreRamFV_ElementRecord_t *elementStore; /* NULL for a split store */
+    void *splitStore;                       /* NULL unless a split store */
+    unsigned long indexSize;                /* 0 if there is no index */
+    KeystoreRamFV_IndexEntry_t *indexStore; /* NULL if there is no index */
+    unsigned long *freeMap;                 /* NULL if there is no free map */
+    unsigned int lazyInit;                  /* initialize elements on first use */
+    KeystoreRamFV_ReadOnlySegment_t const *readOnlySegment; /* NULL if none */
+    unsigned char *fingerprints;            /* NULL if there are none */
+    unsigned int *hitCounters;              /* NULL if there are none */
+    KeystoreRamFV_LookupCache_t *lookupCache; /* NULL if there is none */
+#if defined(KeystoreRamFV_STATISTICS)
+    KeystoreRamFV_Statistics_t *statistics; /* NULL to count nothing */
+#endif
+#if defined(KeystoreRamFV_TIMING)
+    KeystoreRamFV_Timing_t *timing;         /* NULL to time nothing */
+#endif
+} KeystoreRamFV_Config_t;
+
 typedef struct KeystoreRamFV_Result {
     unsigned int error;
     unsigned long index;
 } KeystoreRamFV_Result_t;
 
+/**
+ * Iterates over the keys of one application, visiting only its elements, in no
+ * particular order, and then its keys in the read only segment. The name of
+ * the current key is always provided, its full record only if asked for. The
+ * current key may be deleted during the iteration, other modifications of the
+ * store end it.
+ */
+typedef struct KeystoreRamFV_Iterator {
+    unsigned int appId;
+    unsigned long index;
+    unsigned long next;
+    char name[KeystoreRamFV_KEY_NAME_SIZE];
+} KeystoreRamFV_Iterator_t;
+
+/**
+ * A borrowed, read only view of a key inside the store, valid as long as
+ * (index, generation) still names the same element occupancy. It has to be
+ * checked with KeystoreRamFV_isViewValid() whenever the store may have been
+ * modified since the view was taken, as deleting or reusing the element
+ * changes the memory it points to.
+ */
+typedef struct KeystoreRamFV_KeyView {
+    unsigned long index;
+    unsigned long generation;
+    unsigned int readOnly;
+    unsigned long dataSize;
+    char const *name;
+    char const *data;
+} KeystoreRamFV_KeyView_t;
+
 void
 KeystoreRamFV_init(
     KeystoreRamFV_t *keyStore,
@@ -75,10 +392,110 @@ KeystoreRamFV_initWithReadOnlyKeys(
     unsigned long maxElements,
     KeystoreRamFV_ElementRecord_t *elementStore);
 
+/**
+ * The store tracks a high water mark, above which all elements are free, and
+ * scans stop there. With lazyInit set in the configuration, the elements above
+ * it are not even initialized by KeystoreRamFV_initWithConfig() but only when
+ * they are allocated for the first time, so initialization does not depend on
+ * the capacity of the store. Their previous content stays in memory until then.
+ * The index is not cleared then either, and the free map is filled a word at a
+ * time.
+ */
+unsigned int
+KeystoreRamFV_initWithConfig(
+    KeystoreRamFV_t *keyStore,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nrKeys);
+
+/* KeystoreRamFV_LAYOUT_VERSION of the library */
+unsigned long
+KeystoreRamFV_getLayoutVersion(void);
+
+/**
+ * Takes over elements that already hold keys, such as ones kept in a file
+ * across a restart, instead of resetting them: the state derived from the
+ * elements, like the index, the free map and the lists of the applications,
+ * is rebuilt from them. The elements of keys that are not read only and not
+ * of the given epoch are stale and zeroed, as are the bytes no key uses where
+ * they are not zero already. Elements that are not valid give
+ * KeystoreRamFV_ERR_INVALID_PARAMETER, duplicated keys
+ * KeystoreRamFV_ERR_DUPLICATED; the elements are not written to then, and
+ * the store must not be used.
+ */
+unsigned int
+KeystoreRamFV_attach(
+    KeystoreRamFV_t *keyStore,
+    KeystoreRamFV_Config_t const *config,
+    unsigned long epoch);
+
 void
 KeystoreRamFV_wipe(
     KeystoreRamFV_t *keyStore);
 
+/**
+ * Wipes all keys that are not read only in constant time, by starting a new
+ * epoch of the store. The elements of the wiped keys are stale: they are
+ * counted as free and no key in them can be found or read any more, but they
+ * are zeroed only later, when they are allocated again or by
+ * KeystoreRamFV_scrubStep(). That one examines up to budget elements and
+ * returns how many are left to examine.
+ */
+void
+KeystoreRamFV_wipeDeferred(
+    KeystoreRamFV_t *keyStore);
+
+unsigned long
+KeystoreRamFV_scrubStep(
+    KeystoreRamFV_t *keyStore,
+    unsigned long budget);
+
+/**
+ * Packs the keys toward the front of the store after many adds and deletes
+ * left free elements between them, so scans, which stop at the high water
+ * mark, and wipes get shorter. Each step moves the key of the highest live
+ * element into the lowest element that is not live, zeroes the element it
+ * left and lowers the high water mark; read only keys are never moved, and
+ * compaction stops at the highest one. Up to budget keys are moved, and
+ * relocate, if not NULL, is told about each after it moved, with its name and
+ * its element indices before and after, as used by KeystoreRamFV_getByIndex();
+ * views of the moved keys become invalid. Returns how many free elements are
+ * left below the high water mark, 0 once no key can be moved down any more.
+ */
+typedef void (*KeystoreRamFV_Relocate_t)(
+    void *context,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    unsigned long from,
+    unsigned long to);
+
+unsigned long
+KeystoreRamFV_compact(
+    KeystoreRamFV_t *keyStore,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context);
+
+/**
+ * Moves frequently used keys toward the start of the store, where scans
+ * without an index find them first, in one pass from the high water mark
+ * down: a key whose hit counter exceeds the one of the key in the element
+ * before it by more than hysteresis swaps places with it, and a key after an
+ * element that is not live moves into that one. Read only keys are never
+ * moved. Afterwards all hit counters are halved, so the order follows the
+ * recent accesses. Called every so many lookups, this is the transpose
+ * heuristic of self-organizing lists. relocate is told about every moved key
+ * as with KeystoreRamFV_compact(), about both keys of a swap only after both
+ * moved. Returns the number of keys moved; 0 without hit counters.
+ */
+unsigned long
+KeystoreRamFV_adapt(
+    KeystoreRamFV_t *keyStore,
+    unsigned int hysteresis,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context);
+
 KeystoreRamFV_Result_t
 KeystoreRamFV_add(
     KeystoreRamFV_t *keyStore,
@@ -98,8 +515,195 @@ KeystoreRamFV_getByIndex(
     unsigned long index,
     KeystoreRamFV_KeyRecord_t *key);
 
+/**
+ * Length aware variants of add, get and getByIndex. Only the first dataSize
+ * bytes of key->data are in use; they alone are copied, and the bytes of
+ * key->data beyond them are left untouched by the get functions. The fixed
+ * size functions behave as if the data were zero padded to
+ * KeystoreRamFV_KEY_DATA_SIZE bytes.
+ */
+KeystoreRamFV_Result_t
+KeystoreRamFV_addWithSize(
+    KeystoreRamFV_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize);
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_getWithSize(
+    KeystoreRamFV_t const *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+unsigned int
+KeystoreRamFV_getByIndexWithSize(
+    KeystoreRamFV_t const *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+unsigned int
+KeystoreRamFV_first(
+    KeystoreRamFV_t const *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key); /* NULL for the name only */
+
+unsigned int
+KeystoreRamFV_next(
+    KeystoreRamFV_t const *keyStore,
+    KeystoreRamFV_Iterator_t *iterator,
+    KeystoreRamFV_KeyRecord_t *key); /* NULL for the name only */
+
+KeystoreRamFV_Result_t
+KeystoreRamFV_borrow(
+    KeystoreRamFV_t const *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyView_t *view);
+
+unsigned int
+KeystoreRamFV_isViewValid(
+    KeystoreRamFV_t const *keyStore,
+    KeystoreRamFV_KeyView_t const *view);
+
 unsigned int
 KeystoreRamFV_delete(
     KeystoreRamFV_t *keyStore,
     unsigned int appId,
     const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+/* the key at index has to belong to appId, like for getByIndex */
+unsigned int
+KeystoreRamFV_deleteByIndex(
+    KeystoreRamFV_t *keyStore,
+    unsigned int appId,
+    unsigned long index);
+
+/**
+ * Looks a key up like get, but without copying it, without counting or
+ * timing the call and without touching the hit counters or the lookup cache,
+ * for wrappers that need the index of a key before they modify it. The slots
+ * and names it looks at are counted in the statistics, as part of the
+ * operation of the wrapper.
+ */
+KeystoreRamFV_Result_t
+KeystoreRamFV_find(
+    KeystoreRamFV_t const *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+/**
+ * Batched get, add and delete. Each resolves all of its nrKeys keys in a
+ * single pass over the store and reports one result per key, the same result
+ * as calling get, add or delete for the keys one after the other would give.
+ * KeystoreRamFV_ERR_INVALID_PARAMETER is returned if an array is missing.
+ */
+unsigned int
+KeystoreRamFV_getBatch(
+    KeystoreRamFV_t const *keyStore,
+    unsigned long nrKeys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *keys,
+    KeystoreRamFV_Result_t *results);
+
+unsigned int
+KeystoreRamFV_addBatch(
+    KeystoreRamFV_t *keyStore,
+    unsigned long nrKeys,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    KeystoreRamFV_Result_t *results);
+
+unsigned int
+KeystoreRamFV_deleteBatch(
+    KeystoreRamFV_t *keyStore,
+    unsigned long nrKeys,
+    unsigned int const *appIds,
+    const char names [][KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_Result_t *results);
+
+/**
+ * A snapshot of the keys in the elements of a store, without the free
+ * elements and without the data beyond the bytes in use, in a versioned
+ * binary format. All numbers are little endian:
+ *
+ *     header:  "KRFV", version (2 bytes), KeystoreRamFV_KEY_NAME_SIZE (2),
+ *              KeystoreRamFV_KEY_DATA_SIZE (4), number of keys (4)
+ *     per key: app id (1), read only flag (1), bytes of data in use (4),
+ *              name, data in use
+ *     trailer: 32 bit FNV-1a of all bytes before it (4)
+ *
+ * The keys of the read only segment are not part of it, they come with the
+ * configuration. Both directions stream the snapshot in pieces of at most a
+ * name or the data of a key, through a writer that takes the given bytes and
+ * a reader that provides exactly the bytes asked for. Each returns
+ * KeystoreRamFV_ERR_NONE, or an error that ends the transfer and is passed on.
+ */
+#define KeystoreRamFV_SNAPSHOT_VERSION 1
+
+typedef unsigned int (*KeystoreRamFV_Writer_t)(
+    void *context,
+    void const *bytes,
+    unsigned long size);
+
+typedef unsigned int (*KeystoreRamFV_Reader_t)(
+    void *context,
+    void *bytes,
+    unsigned long size);
+
+unsigned int
+KeystoreRamFV_export(
+    KeystoreRamFV_t const *keyStore,
+    KeystoreRamFV_Writer_t write,
+    void *context);
+
+/**
+ * Initializes the store with the configuration and loads the snapshot into it
+ * in a single pass. A snapshot of another version or name size, or one with
+ * invalid keys, gives KeystoreRamFV_ERR_INVALID_PARAMETER, one with more keys
+ * than elements KeystoreRamFV_ERR_OUT_OF_SPACE, one with a duplicated key
+ * KeystoreRamFV_ERR_DUPLICATED and one with a wrong checksum
+ * KeystoreRamFV_ERR_GENERIC. On any error the store is left empty.
+ */
+unsigned int
+KeystoreRamFV_import(
+    KeystoreRamFV_t *keyStore,
+    KeystoreRamFV_Config_t const *config,
+    KeystoreRamFV_Reader_t read,
+    void *context);
+
+#if defined(KeystoreRamFV_STATISTICS)
+/**
+ * Copies the counters of the store to snapshot, all zero if it has none, and
+ * sets them back to zero, respectively.
+ */
+void
+KeystoreRamFV_getStatistics(
+    KeystoreRamFV_t const *keyStore,
+    KeystoreRamFV_Statistics_t *snapshot);
+
+void
+KeystoreRamFV_resetStatistics(
+    KeystoreRamFV_t const *keyStore);
+#endif
+
+#if defined(KeystoreRamFV_TIMING)
+/**
+ * Reports the latencies of all operations, indexed by KeystoreRamFV_OP_*, all
+ * zero if the store has no histograms, and clears the histograms,
+ * respectively.
+ */
+void
+KeystoreRamFV_getLatencies(
+    KeystoreRamFV_t const *keyStore,
+    KeystoreRamFV_Latency_t latencies[KeystoreRamFV_NR_OPS]);
+
+void
+KeystoreRamFV_resetLatencies(
+    KeystoreRamFV_t const *keyStore);
+#endif
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+extern "C"
+{
+#include "KeystoreRamFV.h"
+}
+
+/**
+ * Header only C++ front end of the KeystoreRamFV, with the capacity and the
+ * sizes of name and data as template parameters instead of global macros, so
+ * stores of different geometry can live in one binary and the name
+ * comparisons and copies are done with sizes known at compile time. The
+ * elements are held inline, nothing is allocated. The semantics and error
+ * codes are those of the C API; only delete is called remove.
+ *
+ * Names are given as string views of up to NameSize characters, zero padded
+ * to NameSize, data as byte spans of up to DataSize bytes.
+ */
+
+namespace fv
+{
+
+/**
+ * A key read out of a store. It is move only, so key material is not copied
+ * unnoticed, and a record that is moved from or destroyed is zeroed.
+ */
+template <std::size_t NameSize, std::size_t DataSize>
+class KeystoreRamFVRecord
+{
+    template <std::size_t, std::size_t, std::size_t>
+    friend class KeystoreRamFV;
+
+    public:
+    KeystoreRamFVRecord() noexcept = default;
+
+    KeystoreRamFVRecord(KeystoreRamFVRecord &&other) noexcept
+    {
+        *this = static_cast<KeystoreRamFVRecord &&>(other);
+    }
+
+    KeystoreRamFVRecord &
+    operator=(KeystoreRamFVRecord &&other) noexcept
+    {
+        if (this != &other)
+        {
+            assign(other.name_, other.data(), other.readOnly_);
+            other.clear();
+        }
+
+        return *this;
+    }
+
+    KeystoreRamFVRecord(KeystoreRamFVRecord const &) = delete;
+    KeystoreRamFVRecord &operator=(KeystoreRamFVRecord const &) = delete;
+
+    ~KeystoreRamFVRecord()
+    {
+        clear();
+    }
+
+    std::string_view
+    name() const noexcept
+    {
+        std::size_t length = 0;
+
+        while (length < NameSize && name_[length] != '\0')
+        {
+            length++;
+        }
+
+        return std::string_view(name_.data(), length);
+    }
+
+    std::span<std::byte const>
+    data() const noexcept
+    {
+        return std::span<std::byte const>(data_.data(), dataSize_);
+    }
+
+    bool
+    readOnly() const noexcept
+    {
+        return readOnly_;
+    }
+
+    private:
+    // Keeps all bytes of data beyond the ones in use zero.
+    void
+    assign(
+        std::array<char, NameSize> const &name,
+        std::span<std::byte const> data,
+        bool readOnly) noexcept
+    {
+        std::size_t previous_size = dataSize_;
+
+        name_ = name;
+        for (std::size_t k = 0; k < data.size(); k++)
+        {
+            data_[k] = data[k];
+        }
+        for (std::size_t k = data.size(); k < previous_size; k++)
+        {
+            data_[k] = std::byte{0};
+        }
+        dataSize_ = data.size();
+        readOnly_ = readOnly;
+    }
+
+    void
+    clear() noexcept
+    {
+        // volatile, as the stores to a dying object are dead otherwise
+        volatile char *name = name_.data();
+        volatile std::byte *data = data_.data();
+
+        for (std::size_t k = 0; k < NameSize; k++)
+        {
+            name[k] = '\0';
+        }
+        for (std::size_t k = 0; k < dataSize_; k++)
+        {
+            data[k] = std::byte{0};
+        }
+        dataSize_ = 0;
+        readOnly_ = false;
+    }
+
+    std::array<char, NameSize> name_{};
+    std::array<std::byte, DataSize> data_{};
+    std::size_t dataSize_ = 0;
+    bool readOnly_ = false;
+};
+
+
+template <
+    std::size_t Capacity,
+    std::size_t NameSize = KeystoreRamFV_KEY_NAME_SIZE,
+    std::size_t DataSize = KeystoreRamFV_KEY_DATA_SIZE>
+class KeystoreRamFV
+{
+    static_assert(Capacity > 0, "a store needs elements");
+    static_assert(NameSize > 0, "keys need a name");
+
+    public:
+    using Record = KeystoreRamFVRecord<NameSize, DataSize>;
+
+    struct ReadOnlyKey
+    {
+        unsigned int appId;
+        std::string_view name;
+        std::span<std::byte const> data;
+    };
+
+    KeystoreRamFV() noexcept = default;
+
+    KeystoreRamFV(KeystoreRamFV const &) = delete;
+    KeystoreRamFV &operator=(KeystoreRamFV const &) = delete;
+
+    ~KeystoreRamFV()
+    {
+        wipeElements(true);
+    }
+
+    static constexpr std::size_t
+    capacity() noexcept
+    {
+        return Capacity;
+    }
+
+    std::size_t
+    freeSlots() const noexcept
+    {
+        return freeSlots_;
+    }
+
+    // Replaces all keys with the given read only ones. If they are not valid,
+    // the store is left empty.
+    unsigned int
+    initWithReadOnlyKeys(std::span<ReadOnlyKey const> keys) noexcept
+    {
+        wipeElements(true);
+        freeSlots_ = Capacity;
+
+        if (keys.size() > Capacity)
+        {
+            return KeystoreRamFV_ERR_GENERIC;
+        }
+
+        for (std::size_t k = 0; k < keys.size(); k++)
+        {
+            if (keys[k].appId > KeystoreRamFV_MAX_APP_ID ||
+                keys[k].name.size() > NameSize ||
+                keys[k].data.size() > DataSize)
+            {
+                wipeElements(true);
+                freeSlots_ = Capacity;
+                return KeystoreRamFV_ERR_INVALID_PARAMETER;
+            }
+
+            std::array<char, NameSize> name = padName(keys[k].name);
+
+            if (findElement(keys[k].appId, name) < Capacity)
+            {
+                wipeElements(true);
+                freeSlots_ = Capacity;
+                return KeystoreRamFV_ERR_DUPLICATED;
+            }
+
+            occupyElement(k, keys[k].appId, name, keys[k].data, true);
+            freeSlots_--;
+        }
+
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    void
+    wipe() noexcept
+    {
+        freeSlots_ += wipeElements(false);
+    }
+
+    KeystoreRamFV_Result_t
+    add(
+        unsigned int appId,
+        std::string_view name,
+        std::span<std::byte const> data) noexcept
+    {
+        KeystoreRamFV_Result_t result =
+            {KeystoreRamFV_ERR_INVALID_PARAMETER, Capacity};
+
+        if (appId > KeystoreRamFV_MAX_APP_ID ||
+            name.size() > NameSize ||
+            data.size() > DataSize)
+        {
+            return result;
+        }
+
+        if (0 == freeSlots_)
+        {
+            result.error = KeystoreRamFV_ERR_OUT_OF_SPACE;
+            return result;
+        }
+
+        std::array<char, NameSize> padded_name = padName(name);
+
+        if (findElement(appId, padded_name) < Capacity)
+        {
+            result.error = KeystoreRamFV_ERR_DUPLICATED;
+            return result;
+        }
+
+        std::size_t index = 0;
+        while (!elements_[index].isFree)
+        {
+            index++;
+        }
+
+        occupyElement(index, appId, padded_name, data, false);
+        freeSlots_--;
+
+        result.error = KeystoreRamFV_ERR_NONE;
+        result.index = index;
+        return result;
+    }
+
+    KeystoreRamFV_Result_t
+    get(unsigned int appId, std::string_view name, Record &key) const noexcept
+    {
+        KeystoreRamFV_Result_t result =
+            {KeystoreRamFV_ERR_INVALID_PARAMETER, Capacity};
+
+        if (appId > KeystoreRamFV_MAX_APP_ID || name.size() > NameSize)
+        {
+            return result;
+        }
+
+        result.index = findElement(appId, padName(name));
+
+        if (Capacity == result.index)
+        {
+            result.error = KeystoreRamFV_ERR_NOT_FOUND;
+            return result;
+        }
+
+        copyElementKey(result.index, key);
+
+        result.error = KeystoreRamFV_ERR_NONE;
+        return result;
+    }
+
+    unsigned int
+    getByIndex(unsigned int appId, std::size_t index, Record &key) const noexcept
+    {
+        if (index >= Capacity || appId > KeystoreRamFV_MAX_APP_ID)
+        {
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+
+        if (elements_[index].isFree)
+        {
+            return KeystoreRamFV_ERR_NOT_FOUND;
+        }
+
+        if (appId != elements_[index].appId)
+        {
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+
+        copyElementKey(index, key);
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    unsigned int
+    remove(unsigned int appId, std::string_view name) noexcept
+    {
+        if (appId > KeystoreRamFV_MAX_APP_ID || name.size() > NameSize)
+        {
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+
+        std::size_t index = findElement(appId, padName(name));
+
+        if (Capacity == index)
+        {
+            return KeystoreRamFV_ERR_NOT_FOUND;
+        }
+
+        if (elements_[index].readOnly)
+        {
+            return KeystoreRamFV_ERR_READ_ONLY;
+        }
+
+        resetElement(index);
+        freeSlots_++;
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    private:
+    struct Element
+    {
+        bool isFree = true;
+        bool readOnly = false;
+        unsigned int appId = 0;
+        std::size_t dataSize = 0; /* all bytes of data beyond are zero */
+        std::array<char, NameSize> name{};
+        std::array<std::byte, DataSize> data{};
+    };
+
+    static std::array<char, NameSize>
+    padName(std::string_view name) noexcept
+    {
+        std::array<char, NameSize> padded_name{};
+
+        for (std::size_t k = 0; k < name.size(); k++)
+        {
+            padded_name[k] = name[k];
+        }
+
+        return padded_name;
+    }
+
+    std::size_t
+    findElement(
+        unsigned int appId,
+        std::array<char, NameSize> const &name) const noexcept
+    {
+        for (std::size_t k = 0; k < Capacity; k++)
+        {
+            if (!elements_[k].isFree &&
+                appId == elements_[k].appId &&
+                name == elements_[k].name)
+            {
+                return k;
+            }
+        }
+
+        return Capacity;
+    }
+
+    void
+    occupyElement(
+        std::size_t index,
+        unsigned int appId,
+        std::array<char, NameSize> const &name,
+        std::span<std::byte const> data,
+        bool readOnly) noexcept
+    {
+        Element &element = elements_[index];
+
+        element.isFree = false;
+        element.readOnly = readOnly;
+        element.appId = appId;
+        element.name = name;
+        for (std::size_t k = 0; k < data.size(); k++)
+        {
+            element.data[k] = data[k];
+        }
+        element.dataSize = data.size();
+    }
+
+    void
+    resetElement(std::size_t index) noexcept
+    {
+        Element &element = elements_[index];
+        volatile char *name = element.name.data();
+        volatile std::byte *data = element.data.data();
+
+        for (std::size_t k = 0; k < NameSize; k++)
+        {
+            name[k] = '\0';
+        }
+        for (std::size_t k = 0; k < element.dataSize; k++)
+        {
+            data[k] = std::byte{0};
+        }
+        element.isFree = true;
+        element.readOnly = false;
+        element.appId = 0;
+        element.dataSize = 0;
+    }
+
+    // Returns the number of elements freed.
+    std::size_t
+    wipeElements(bool readOnlyToo) noexcept
+    {
+        std::size_t freed = 0;
+
+        for (std::size_t k = 0; k < Capacity; k++)
+        {
+            if (!elements_[k].isFree && (readOnlyToo || !elements_[k].readOnly))
+            {
+                resetElement(k);
+                freed++;
+            }
+        }
+
+        return freed;
+    }
+
+    void
+    copyElementKey(std::size_t index, Record &key) const noexcept
+    {
+        Element const &element = elements_[index];
+
+        key.assign(
+            element.name,
+            std::span<std::byte const>(element.data.data(), element.dataSize),
+            element.readOnly);
+    }
+
+    std::array<Element, Capacity> elements_{};
+    std::size_t freeSlots_ = Capacity;
+};
+
+} // namespace fv
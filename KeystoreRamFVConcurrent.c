@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#include "KeystoreRamFVConcurrent.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+static void
+lockWriter(KeystoreRamFVConcurrent_t *key_store)
+{
+    unsigned int unlocked = 0;
+
+    while (!atomic_compare_exchange_weak_explicit(
+               &key_store->writerLock,
+               &unlocked,
+               1,
+               memory_order_acquire,
+               memory_order_relaxed))
+    {
+        unlocked = 0;
+    }
+
+    // an odd sequence tells readers that the store is being modified
+    atomic_store_explicit(
+        &key_store->sequence,
+        atomic_load_explicit(&key_store->sequence, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+
+static void
+unlockWriter(KeystoreRamFVConcurrent_t *key_store)
+{
+    atomic_store_explicit(
+        &key_store->sequence,
+        atomic_load_explicit(&key_store->sequence, memory_order_relaxed) + 1,
+        memory_order_release);
+    atomic_store_explicit(&key_store->writerLock, 0, memory_order_release);
+}
+
+
+// Returns the even sequence at which a read may start.
+static unsigned long
+beginRead(KeystoreRamFVConcurrent_t *key_store)
+{
+    unsigned long sequence;
+
+    do
+    {
+        sequence = atomic_load_explicit(&key_store->sequence, memory_order_acquire);
+    }
+    while (sequence & 1);
+
+    return sequence;
+}
+
+
+// Tells whether the read since beginRead() overlapped with a modification.
+static unsigned int
+retryRead(KeystoreRamFVConcurrent_t *key_store, unsigned long sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+
+    return sequence !=
+           atomic_load_explicit(&key_store->sequence, memory_order_relaxed);
+}
+
+
+// Tells whether lookups of the configured store write to it, which readers
+// running in parallel would race on.
+static unsigned int
+isWrittenByLookups(KeystoreRamFV_Config_t const *config)
+{
+#if defined(KeystoreRamFV_STATISTICS)
+    if (config->statistics != NULL)
+    {
+        return 1;
+    }
+#endif
+#if defined(KeystoreRamFV_TIMING)
+    if (config->timing != NULL)
+    {
+        return 1;
+    }
+#endif
+
+    return config->hitCounters != NULL || config->lookupCache != NULL;
+}
+
+
+unsigned int
+KeystoreRamFVConcurrent_init(
+    KeystoreRamFVConcurrent_t *key_store,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nr_keys)
+{
+    // lazy initialization makes elements part of the store, by moving the
+    // high water mark, with no ordering that lookups could rely on
+    if (config != NULL && (isWrittenByLookups(config) || config->lazyInit))
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    atomic_init(&key_store->writerLock, 0);
+    atomic_init(&key_store->sequence, 0);
+
+    return KeystoreRamFV_initWithConfig(
+               &key_store->keyStore,
+               config,
+               appIds,
+               keys,
+               nr_keys);
+}
+
+void
+KeystoreRamFVConcurrent_wipe(KeystoreRamFVConcurrent_t *key_store)
+{
+    lockWriter(key_store);
+    KeystoreRamFV_wipe(&key_store->keyStore);
+    unlockWriter(key_store);
+}
+
+void
+KeystoreRamFVConcurrent_wipeDeferred(KeystoreRamFVConcurrent_t *key_store)
+{
+    lockWriter(key_store);
+    KeystoreRamFV_wipeDeferred(&key_store->keyStore);
+    unlockWriter(key_store);
+}
+
+unsigned long
+KeystoreRamFVConcurrent_scrubStep(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned long budget)
+{
+    lockWriter(key_store);
+    unsigned long result = KeystoreRamFV_scrubStep(&key_store->keyStore, budget);
+    unlockWriter(key_store);
+
+    return result;
+}
+
+unsigned long
+KeystoreRamFVConcurrent_compact(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context)
+{
+    lockWriter(key_store);
+    unsigned long result = KeystoreRamFV_compact(
+                               &key_store->keyStore,
+                               budget,
+                               relocate,
+                               context);
+    unlockWriter(key_store);
+
+    return result;
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_add(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key)
+{
+    return KeystoreRamFVConcurrent_addWithSize(
+               key_store,
+               appId,
+               key,
+               KeystoreRamFV_KEY_DATA_SIZE);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_addWithSize(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    lockWriter(key_store);
+    KeystoreRamFV_Result_t result = KeystoreRamFV_addWithSize(
+                                        &key_store->keyStore,
+                                        appId,
+                                        key,
+                                        dataSize);
+    unlockWriter(key_store);
+
+    return result;
+}
+
+unsigned int
+KeystoreRamFVConcurrent_delete(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    lockWriter(key_store);
+    unsigned int result = KeystoreRamFV_delete(&key_store->keyStore, appId, name);
+    unlockWriter(key_store);
+
+    return result;
+}
+
+// The store may change under a reader, but every lookup in it is bounded and
+// stays within the elements, so a read that overlapped does no harm and is
+// simply repeated.
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_get(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    KeystoreRamFV_Result_t result;
+    unsigned long sequence;
+
+    do
+    {
+        sequence = beginRead(key_store);
+        result = KeystoreRamFV_get(&key_store->keyStore, appId, name, key);
+    }
+    while (retryRead(key_store, sequence));
+
+    return result;
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_getWithSize(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    KeystoreRamFV_Result_t result;
+    unsigned long sequence;
+
+    do
+    {
+        sequence = beginRead(key_store);
+        result = KeystoreRamFV_getWithSize(
+                     &key_store->keyStore,
+                     appId,
+                     name,
+                     key,
+                     dataSize);
+    }
+    while (retryRead(key_store, sequence));
+
+    return result;
+}
+
+unsigned int
+KeystoreRamFVConcurrent_getByIndex(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    unsigned int result;
+    unsigned long sequence;
+
+    do
+    {
+        sequence = beginRead(key_store);
+        result = KeystoreRamFV_getByIndex(&key_store->keyStore, appId, index, key);
+    }
+    while (retryRead(key_store, sequence));
+
+    return result;
+}
+
+unsigned int
+KeystoreRamFVConcurrent_getByIndexWithSize(
+    KeystoreRamFVConcurrent_t *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    unsigned int result;
+    unsigned long sequence;
+
+    do
+    {
+        sequence = beginRead(key_store);
+        result = KeystoreRamFV_getByIndexWithSize(
+                     &key_store->keyStore,
+                     appId,
+                     index,
+                     key,
+                     dataSize);
+    }
+    while (retryRead(key_store, sequence));
+
+    return result;
+}
+
+unsigned long
+KeystoreRamFVConcurrent_getFreeSlots(KeystoreRamFVConcurrent_t *key_store)
+{
+    unsigned long result;
+    unsigned long sequence;
+
+    do
+    {
+        sequence = beginRead(key_store);
+        result = key_store->keyStore.freeSlots;
+    }
+    while (retryRead(key_store, sequence));
+
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#if defined(__cplusplus)
+#   include <atomic>
+#   define KeystoreRamFVConcurrent_ATOMIC(type) std::atomic<type>
+#else
+#   include <stdatomic.h>
+#   define KeystoreRamFVConcurrent_ATOMIC(type) _Atomic type
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "KeystoreRamFV.h"
+
+/**
+ * A KeystoreRamFV that may be used by several threads at once. Modifications
+ * are serialized by a spin lock and bracketed by a sequence counter, which is
+ * odd while one is in progress. The get functions take no lock: they read
+ * optimistically and retry whenever the sequence counter shows that a
+ * modification overlapped, so they never return a torn key, and a key they
+ * return was in the store at one point during the call. All calls are
+ * linearizable. Readers do not block writers, but keep retrying while writers
+ * are busy.
+ */
+typedef struct KeystoreRamFVConcurrent {
+    KeystoreRamFV_t keyStore;
+    KeystoreRamFVConcurrent_ATOMIC(unsigned int) writerLock;
+    KeystoreRamFVConcurrent_ATOMIC(unsigned long) sequence;
+} KeystoreRamFVConcurrent_t;
+
+/**
+ * Not thread safe, no other call may be in progress. A configuration with hit
+ * counters, a lookup cache, statistics or timing gives
+ * KeystoreRamFV_ERR_INVALID_PARAMETER, as lookups write to them and would race
+ * with each other, and so does lazyInit, as readers could see an element
+ * before it is initialized.
+ */
+unsigned int
+KeystoreRamFVConcurrent_init(
+    KeystoreRamFVConcurrent_t *keyStore,
+    KeystoreRamFV_Config_t const *config,
+    unsigned int const *appIds,
+    KeystoreRamFV_KeyRecord_t const *keys,
+    unsigned long nrKeys);
+
+void
+KeystoreRamFVConcurrent_wipe(
+    KeystoreRamFVConcurrent_t *keyStore);
+
+void
+KeystoreRamFVConcurrent_wipeDeferred(
+    KeystoreRamFVConcurrent_t *keyStore);
+
+unsigned long
+KeystoreRamFVConcurrent_scrubStep(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned long budget);
+
+/* relocate is called with the writer lock held */
+unsigned long
+KeystoreRamFVConcurrent_compact(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_add(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_addWithSize(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize);
+
+unsigned int
+KeystoreRamFVConcurrent_delete(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_get(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVConcurrent_getWithSize(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+unsigned int
+KeystoreRamFVConcurrent_getByIndex(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key);
+
+unsigned int
+KeystoreRamFVConcurrent_getByIndexWithSize(
+    KeystoreRamFVConcurrent_t *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+/* the free elements at one point during the call */
+unsigned long
+KeystoreRamFVConcurrent_getFreeSlots(
+    KeystoreRamFVConcurrent_t *keyStore);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#if !defined(_POSIX_C_SOURCE)
+#   define _POSIX_C_SOURCE 200809L /* for ftruncate(), msync() and sysconf() */
+#endif
+
+#include "KeystoreRamFVFile.h"
+
+#include "stdlib_fv.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+static char const magic[8] = {'K', 'R', 'F', 'V', 'F', 'I', 'L', 'E'};
+
+
+static KeystoreRamFVFile_Header_t *
+fileHeader(KeystoreRamFVFile_t const *file)
+{
+    return (KeystoreRamFVFile_Header_t *) file->mapping;
+}
+
+
+static KeystoreRamFV_ElementRecord_t *
+fileElements(KeystoreRamFVFile_t const *file)
+{
+    return (KeystoreRamFV_ElementRecord_t *)
+           (file->mapping + KeystoreRamFVFile_ELEMENTS_OFFSET);
+}
+
+
+// 32 bit FNV-1a over the fields before the checksum
+static unsigned long
+headerChecksum(KeystoreRamFVFile_Header_t const *header)
+{
+    unsigned char const *bytes = (unsigned char const *) header;
+    unsigned long checksum = 2166136261UL;
+
+    for (unsigned long k = 0; k < offsetof(KeystoreRamFVFile_Header_t, checksum); k++)
+    {
+        checksum = ((checksum ^ bytes[k]) * 16777619UL) & 0xffffffffUL;
+    }
+
+    return checksum;
+}
+
+
+static unsigned int
+isHeaderValid(
+    KeystoreRamFVFile_Header_t const *header,
+    unsigned long max_elements)
+{
+    return 0 == memcmp_fv(header->magic, magic, sizeof(magic)) &&
+           KeystoreRamFVFile_VERSION == header->version &&
+           KeystoreRamFV_LAYOUT_VERSION == header->layoutVersion &&
+           max_elements == header->maxElements &&
+           sizeof(KeystoreRamFV_ElementRecord_t) == header->elementSize &&
+           KeystoreRamFV_KEY_NAME_SIZE == header->nameSize &&
+           KeystoreRamFV_KEY_DATA_SIZE == header->dataSize &&
+           headerChecksum(header) == header->checksum;
+}
+
+
+// A header of zeros was never written, as the header comes last when a file is
+// created: creating it was interrupted.
+static unsigned int
+isHeaderUnwritten(KeystoreRamFVFile_Header_t const *header)
+{
+    unsigned char const *bytes = (unsigned char const *) header;
+
+    for (unsigned long k = 0; k < sizeof(KeystoreRamFVFile_Header_t); k++)
+    {
+        if (bytes[k] != 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+// Writes the bytes from begin to end of the mapping back to the file.
+static unsigned int
+syncRange(KeystoreRamFVFile_t *file, unsigned long begin, unsigned long end)
+{
+    // msync() wants the address aligned to a page
+    unsigned long page_size = (unsigned long) sysconf(_SC_PAGESIZE);
+    unsigned long aligned_begin = begin - begin % page_size;
+
+    if (0 != msync(file->mapping + aligned_begin, end - aligned_begin, MS_SYNC))
+    {
+        return KeystoreRamFV_ERR_GENERIC;
+    }
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+
+static unsigned int
+syncHeader(KeystoreRamFVFile_t *file)
+{
+    fileHeader(file)->epoch = file->keyStore.epoch;
+    fileHeader(file)->checksum = headerChecksum(fileHeader(file));
+
+    return syncRange(file, 0, sizeof(KeystoreRamFVFile_Header_t));
+}
+
+
+static unsigned int
+syncElements(KeystoreRamFVFile_t *file)
+{
+    unsigned int result = KeystoreRamFV_ERR_NONE;
+
+    if (file->dirtyElements > 0)
+    {
+        result = syncRange(
+                     file,
+                     KeystoreRamFVFile_ELEMENTS_OFFSET +
+                     file->dirtyBegin * sizeof(KeystoreRamFV_ElementRecord_t),
+                     KeystoreRamFVFile_ELEMENTS_OFFSET +
+                     file->dirtyEnd * sizeof(KeystoreRamFV_ElementRecord_t));
+    }
+
+    file->dirtyElements = 0;
+    file->dirtyBegin = file->keyStore.maxElements;
+    file->dirtyEnd = 0;
+    return result;
+}
+
+
+// Notes that the elements from begin to end were touched, and syncs them once
+// enough of them are.
+static void
+touchElements(KeystoreRamFVFile_t *file, unsigned long begin, unsigned long end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    file->dirtyBegin = (begin < file->dirtyBegin) ? begin : file->dirtyBegin;
+    file->dirtyEnd = (end > file->dirtyEnd) ? end : file->dirtyEnd;
+    file->dirtyElements += end - begin;
+
+    if (file->syncGranularity > 0 && file->dirtyElements >= file->syncGranularity)
+    {
+        syncElements(file);
+    }
+}
+
+
+static void
+closeFile(KeystoreRamFVFile_t *file)
+{
+    if (file->mapping != NULL)
+    {
+        munmap(file->mapping, file->mappingSize);
+        file->mapping = NULL;
+    }
+
+    close(file->fd);
+    file->fd = -1;
+}
+
+
+unsigned int
+KeystoreRamFVFile_open(
+    KeystoreRamFVFile_t *file,
+    KeystoreRamFVFile_Config_t const *config,
+    unsigned int *attached)
+{
+    struct stat file_stat;
+
+    if (config == NULL || config->path == NULL || attached == NULL ||
+        config->config.splitStore != NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    unsigned long max_elements = config->config.maxElements;
+
+    file->mapping = NULL;
+    file->mappingSize = KeystoreRamFVFile_ELEMENTS_OFFSET +
+                        max_elements * sizeof(KeystoreRamFV_ElementRecord_t);
+    file->syncGranularity = config->syncGranularity;
+    file->dirtyElements = 0;
+    file->dirtyBegin = max_elements;
+    file->dirtyEnd = 0;
+    *attached = 0;
+
+    file->fd = open(config->path, O_RDWR | O_CREAT, 0600);
+    if (file->fd < 0)
+    {
+        return KeystoreRamFV_ERR_GENERIC;
+    }
+
+    if (0 != fstat(file->fd, &file_stat))
+    {
+        closeFile(file);
+        return KeystoreRamFV_ERR_GENERIC;
+    }
+
+    unsigned int is_empty = (0 == file_stat.st_size);
+
+    if (!is_empty && file->mappingSize != (unsigned long) file_stat.st_size)
+    {
+        closeFile(file);
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    if (is_empty && 0 != ftruncate(file->fd, (off_t) file->mappingSize))
+    {
+        closeFile(file);
+        return KeystoreRamFV_ERR_GENERIC;
+    }
+
+    void *mapping = mmap(
+                        NULL,
+                        file->mappingSize,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        file->fd,
+                        0);
+    if (MAP_FAILED == mapping)
+    {
+        closeFile(file);
+        return KeystoreRamFV_ERR_GENERIC;
+    }
+
+    file->mapping = (char *) mapping;
+
+    KeystoreRamFV_Config_t store_config = config->config;
+    store_config.elementStore = fileElements(file);
+    // a new file is all zero, which are no free elements
+    store_config.lazyInit = 0;
+
+    // a file whose creation was interrupted is created again
+    unsigned int is_new = is_empty || isHeaderUnwritten(fileHeader(file));
+
+    if (!is_new)
+    {
+        if (!isHeaderValid(fileHeader(file), max_elements))
+        {
+            closeFile(file);
+            return KeystoreRamFV_ERR_INVALID_PARAMETER;
+        }
+
+        unsigned int result = KeystoreRamFV_attach(
+                                  &file->keyStore,
+                                  &store_config,
+                                  fileHeader(file)->epoch);
+        if (KeystoreRamFV_ERR_NONE != result)
+        {
+            closeFile(file);
+            return result;
+        }
+
+        // attaching scrubs stale elements
+        touchElements(file, 0, max_elements);
+        *attached = 1;
+        return syncElements(file);
+    }
+
+    unsigned int result = KeystoreRamFV_initWithConfig(
+                              &file->keyStore,
+                              &store_config,
+                              NULL,
+                              NULL,
+                              0);
+    if (KeystoreRamFV_ERR_NONE != result)
+    {
+        // leaves the file empty, as if it had not been created
+        unsigned int emptied = (0 == ftruncate(file->fd, 0));
+        closeFile(file);
+        return emptied ? result : KeystoreRamFV_ERR_GENERIC;
+    }
+
+    KeystoreRamFVFile_Header_t *header = fileHeader(file);
+
+    memcpy_fv(header->magic, magic, sizeof(magic));
+    header->version = KeystoreRamFVFile_VERSION;
+    header->layoutVersion = KeystoreRamFV_LAYOUT_VERSION;
+    header->maxElements = max_elements;
+    header->elementSize = sizeof(KeystoreRamFV_ElementRecord_t);
+    header->nameSize = KeystoreRamFV_KEY_NAME_SIZE;
+    header->dataSize = KeystoreRamFV_KEY_DATA_SIZE;
+
+    // the header comes last, a file without it is not taken up again
+    touchElements(file, 0, max_elements);
+    result = syncElements(file);
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        result = syncHeader(file);
+    }
+
+    return result;
+}
+
+
+unsigned int
+KeystoreRamFVFile_sync(KeystoreRamFVFile_t *file)
+{
+    unsigned int result = syncElements(file);
+
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        result = syncHeader(file);
+    }
+
+    return result;
+}
+
+
+unsigned int
+KeystoreRamFVFile_close(KeystoreRamFVFile_t *file)
+{
+    unsigned int result = KeystoreRamFVFile_sync(file);
+
+    closeFile(file);
+    return result;
+}
+
+
+void
+KeystoreRamFVFile_wipe(KeystoreRamFVFile_t *file)
+{
+    unsigned long high_water = file->keyStore.highWater;
+
+    KeystoreRamFV_wipe(&file->keyStore);
+    touchElements(file, 0, high_water);
+}
+
+
+void
+KeystoreRamFVFile_wipeDeferred(KeystoreRamFVFile_t *file)
+{
+    KeystoreRamFV_wipeDeferred(&file->keyStore);
+
+    // the wiped keys must not come back after a restart, whatever the sync
+    // granularity, and only the new epoch in the header keeps them away
+    syncHeader(file);
+}
+
+
+unsigned long
+KeystoreRamFVFile_scrubStep(KeystoreRamFVFile_t *file, unsigned long budget)
+{
+    unsigned long begin = file->keyStore.scrubCursor;
+    unsigned long left = KeystoreRamFV_scrubStep(&file->keyStore, budget);
+
+    if (begin < file->keyStore.maxElements)
+    {
+        touchElements(file, begin, file->keyStore.scrubCursor);
+    }
+
+    return left;
+}
+
+
+typedef struct FileRelocation {
+    KeystoreRamFVFile_t *file;
+    KeystoreRamFV_Relocate_t relocate;
+    void *context;
+} FileRelocation_t;
+
+
+static void
+relocateInFile(
+    void *context,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    unsigned long from,
+    unsigned long to)
+{
+    FileRelocation_t *relocation = (FileRelocation_t *) context;
+
+    touchElements(relocation->file, to, to + 1);
+    touchElements(relocation->file, from, from + 1);
+
+    if (relocation->relocate != NULL)
+    {
+        relocation->relocate(relocation->context, appId, name, from, to);
+    }
+}
+
+
+unsigned long
+KeystoreRamFVFile_compact(
+    KeystoreRamFVFile_t *file,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context)
+{
+    FileRelocation_t relocation = {file, relocate, context};
+    unsigned long high_water = file->keyStore.highWater;
+    unsigned long left = KeystoreRamFV_compact(
+                             &file->keyStore,
+                             budget,
+                             relocateInFile,
+                             &relocation);
+
+    // stale elements scrubbed while lowering the high water mark
+    touchElements(file, file->keyStore.highWater, high_water);
+    return left;
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFVFile_add(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key)
+{
+    return KeystoreRamFVFile_addWithSize(
+               file,
+               appId,
+               key,
+               KeystoreRamFV_KEY_DATA_SIZE);
+}
+
+
+KeystoreRamFV_Result_t
+KeystoreRamFVFile_addWithSize(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    KeystoreRamFV_Result_t result = KeystoreRamFV_addWithSize(
+                                        &file->keyStore,
+                                        appId,
+                                        key,
+                                        dataSize);
+
+    if (KeystoreRamFV_ERR_NONE == result.error)
+    {
+        touchElements(file, result.index, result.index + 1);
+    }
+
+    return result;
+}
+
+
+unsigned int
+KeystoreRamFVFile_delete(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    // found without side effects, so only the delete itself is counted
+    KeystoreRamFV_Result_t found = KeystoreRamFV_find(&file->keyStore, appId, name);
+
+    if (KeystoreRamFV_ERR_NONE != found.error)
+    {
+        return found.error;
+    }
+
+    unsigned int result = KeystoreRamFV_deleteByIndex(&file->keyStore, appId, found.index);
+
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        touchElements(file, found.index, found.index + 1);
+    }
+
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
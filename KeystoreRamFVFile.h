@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#include "KeystoreRamFV.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * A store whose elements live in a memory mapped file, so its keys survive a
+ * restart. The file starts with a header, followed by the elements as an
+ * array of KeystoreRamFV_ElementRecord_t at KeystoreRamFVFile_ELEMENTS_OFFSET:
+ *
+ *     magic "KRFVFILE", version, KeystoreRamFV_LAYOUT_VERSION of the
+ *     elements, maxElements, size of an element, name size, data size,
+ *     epoch of the store, checksum of the fields before it
+ *
+ * Opening a file with a valid header of the configured geometry attaches the
+ * store to its elements, see KeystoreRamFV_attach(), a missing or empty file
+ * is created with an empty store. As the header is written last, a file of
+ * the configured size whose header is all zero was not created completely and
+ * is created again, and a file whose store cannot be initialized is left
+ * empty. A file of another geometry, or with a
+ * damaged header, is not touched and gives KeystoreRamFV_ERR_INVALID_PARAMETER,
+ * failing file operations KeystoreRamFV_ERR_GENERIC.
+ *
+ * Keys are read with the functions of KeystoreRamFV on &keyStore, but changed
+ * only with the functions below, which keep track of the elements they touch.
+ * Every syncGranularity touched elements, these are written back to the file
+ * with msync(); with 1, every change is in the file when its function
+ * returns, with 0 only after KeystoreRamFVFile_sync() or _close(). A change
+ * that is interrupted by a crash before it is synced may be lost or leave its
+ * element damaged.
+ */
+#define KeystoreRamFVFile_VERSION 2
+#define KeystoreRamFVFile_ELEMENTS_OFFSET 4096
+
+typedef struct KeystoreRamFVFile_Header {
+    char magic[8];
+    unsigned long version;
+    unsigned long layoutVersion;
+    unsigned long maxElements;
+    unsigned long elementSize;
+    unsigned long nameSize;
+    unsigned long dataSize;
+    unsigned long epoch;
+    unsigned long checksum;
+} KeystoreRamFVFile_Header_t;
+
+typedef struct KeystoreRamFVFile {
+    KeystoreRamFV_t keyStore;
+    int fd;
+    char *mapping;
+    unsigned long mappingSize;
+    unsigned long syncGranularity;
+    unsigned long dirtyElements; /* touched since the last sync */
+    unsigned long dirtyBegin;    /* range of the touched elements */
+    unsigned long dirtyEnd;
+} KeystoreRamFVFile_t;
+
+typedef struct KeystoreRamFVFile_Config {
+    char const *path;
+    KeystoreRamFV_Config_t config; /* the element store is the file */
+    unsigned long syncGranularity; /* 0 to sync explicitly only */
+} KeystoreRamFVFile_Config_t;
+
+/* attached is set to 1 if the keys of an existing file were taken over */
+unsigned int
+KeystoreRamFVFile_open(
+    KeystoreRamFVFile_t *file,
+    KeystoreRamFVFile_Config_t const *config,
+    unsigned int *attached);
+
+unsigned int
+KeystoreRamFVFile_sync(
+    KeystoreRamFVFile_t *file);
+
+/* syncs and unmaps the file, the store must not be used any more */
+unsigned int
+KeystoreRamFVFile_close(
+    KeystoreRamFVFile_t *file);
+
+void
+KeystoreRamFVFile_wipe(
+    KeystoreRamFVFile_t *file);
+
+/* the wipe is in the file when it returns, also with a syncGranularity of 0 */
+void
+KeystoreRamFVFile_wipeDeferred(
+    KeystoreRamFVFile_t *file);
+
+unsigned long
+KeystoreRamFVFile_scrubStep(
+    KeystoreRamFVFile_t *file,
+    unsigned long budget);
+
+unsigned long
+KeystoreRamFVFile_compact(
+    KeystoreRamFVFile_t *file,
+    unsigned long budget,
+    KeystoreRamFV_Relocate_t relocate,
+    void *context);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVFile_add(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVFile_addWithSize(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize);
+
+unsigned int
+KeystoreRamFVFile_delete(
+    KeystoreRamFVFile_t *file,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#include "KeystoreRamFVGrowable.h"
+
+#include "stdlib_fv.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+// The index given for keys that are not found, as maxElements of a store.
+static unsigned long
+noIndex(KeystoreRamFVGrowable_t const *key_store)
+{
+    return key_store->maxChunks * key_store->chunkElements;
+}
+
+
+// Returns the chunk that holds the key, or nrChunks, with the result of
+// looking for it there. The chunk skipped is not asked.
+static unsigned long
+findChunk(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    unsigned long skipped,
+    KeystoreRamFV_Result_t *result)
+{
+    for (unsigned long c = 0; c < key_store->nrChunks; c++)
+    {
+        if (c == skipped)
+        {
+            continue;
+        }
+
+        *result = KeystoreRamFV_find(&key_store->chunks[c].keyStore, appId, name);
+
+        if (KeystoreRamFV_ERR_NOT_FOUND != result->error)
+        {
+            return c;
+        }
+    }
+
+    return key_store->nrChunks;
+}
+
+
+static unsigned int
+growChunks(KeystoreRamFVGrowable_t *key_store)
+{
+    if (key_store->nrChunks == key_store->maxChunks)
+    {
+        return KeystoreRamFV_ERR_OUT_OF_SPACE;
+    }
+
+    KeystoreRamFVGrowable_Chunk_t *chunk = &key_store->chunks[key_store->nrChunks];
+
+    memset_fv(&chunk->config, 0, sizeof(chunk->config));
+    chunk->config.maxElements = key_store->chunkElements;
+
+    if (KeystoreRamFV_ERR_NONE != key_store->grow(key_store->context, key_store->nrChunks, &chunk->config))
+    {
+        return KeystoreRamFV_ERR_OUT_OF_SPACE;
+    }
+
+    unsigned int result = KeystoreRamFV_ERR_INVALID_PARAMETER;
+
+    if (key_store->chunkElements == chunk->config.maxElements &&
+        chunk->config.readOnlySegment == NULL)
+    {
+        result = KeystoreRamFV_initWithConfig(
+                     &chunk->keyStore,
+                     &chunk->config,
+                     NULL,
+                     NULL,
+                     0);
+    }
+
+    if (KeystoreRamFV_ERR_NONE == result)
+    {
+        key_store->nrChunks++;
+    }
+    // a chunk that cannot be used is given back right away
+    else if (key_store->shrink != NULL)
+    {
+        key_store->shrink(key_store->context, key_store->nrChunks, &chunk->config);
+    }
+
+    return result;
+}
+
+
+// Asks one chunk after the other, with the fixed size get if dataSize is NULL.
+static KeystoreRamFV_Result_t
+lookupKey(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    KeystoreRamFV_Result_t result = {KeystoreRamFV_ERR_INVALID_PARAMETER, noIndex(key_store)};
+
+    // checked here as well, as there may be no chunk to check them
+    if (name == NULL || key == NULL || appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return result;
+    }
+
+    result.error = KeystoreRamFV_ERR_NOT_FOUND;
+
+    for (unsigned long c = 0; c < key_store->nrChunks; c++)
+    {
+        KeystoreRamFV_t const *chunk = &key_store->chunks[c].keyStore;
+
+        result = (dataSize == NULL) ?
+                 KeystoreRamFV_get(chunk, appId, name, key) :
+                 KeystoreRamFV_getWithSize(chunk, appId, name, key, dataSize);
+
+        if (KeystoreRamFV_ERR_NONE == result.error)
+        {
+            result.index += c * key_store->chunkElements;
+            return result;
+        }
+
+        if (KeystoreRamFV_ERR_NOT_FOUND != result.error)
+        {
+            break;
+        }
+    }
+
+    result.index = noIndex(key_store);
+    return result;
+}
+
+
+static unsigned int
+lookupIndex(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    unsigned long c = index / key_store->chunkElements;
+
+    if (key == NULL || appId > KeystoreRamFV_MAX_APP_ID || c >= key_store->maxChunks)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    // the key of a chunk given back is as gone as a deleted one
+    if (c >= key_store->nrChunks)
+    {
+        return KeystoreRamFV_ERR_NOT_FOUND;
+    }
+
+    KeystoreRamFV_t const *chunk = &key_store->chunks[c].keyStore;
+    unsigned long chunk_index = index % key_store->chunkElements;
+
+    return (dataSize == NULL) ?
+           KeystoreRamFV_getByIndex(chunk, appId, chunk_index, key) :
+           KeystoreRamFV_getByIndexWithSize(chunk, appId, chunk_index, key, dataSize);
+}
+
+
+unsigned int
+KeystoreRamFVGrowable_init(
+    KeystoreRamFVGrowable_t *key_store,
+    KeystoreRamFVGrowable_Config_t const *config)
+{
+    if (config == NULL || config->chunks == NULL || config->grow == NULL ||
+        0 == config->maxChunks || 0 == config->chunkElements)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    key_store->chunks = config->chunks;
+    key_store->maxChunks = config->maxChunks;
+    key_store->nrChunks = 0;
+    key_store->chunkElements = config->chunkElements;
+    key_store->grow = config->grow;
+    key_store->shrink = config->shrink;
+    key_store->context = config->context;
+
+    return KeystoreRamFV_ERR_NONE;
+}
+
+void
+KeystoreRamFVGrowable_wipe(KeystoreRamFVGrowable_t *key_store)
+{
+    for (unsigned long c = 0; c < key_store->nrChunks; c++)
+    {
+        KeystoreRamFV_wipe(&key_store->chunks[c].keyStore);
+    }
+}
+
+unsigned long
+KeystoreRamFVGrowable_shrink(KeystoreRamFVGrowable_t *key_store)
+{
+    unsigned long released = 0;
+
+    if (key_store->shrink == NULL)
+    {
+        return 0;
+    }
+
+    // only chunks at the end, so the indices of the others stay the same
+    while (key_store->nrChunks > 0)
+    {
+        KeystoreRamFVGrowable_Chunk_t *chunk = &key_store->chunks[key_store->nrChunks - 1];
+
+        if (chunk->keyStore.freeSlots != chunk->keyStore.maxElements)
+        {
+            break;
+        }
+
+        // leaves nothing of deleted keys in the memory given back
+        KeystoreRamFV_wipe(&chunk->keyStore);
+
+        key_store->nrChunks--;
+        key_store->shrink(key_store->context, key_store->nrChunks, &chunk->config);
+        released++;
+    }
+
+    return released;
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_add(
+    KeystoreRamFVGrowable_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key)
+{
+    return KeystoreRamFVGrowable_addWithSize(
+               key_store,
+               appId,
+               key,
+               KeystoreRamFV_KEY_DATA_SIZE);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_addWithSize(
+    KeystoreRamFVGrowable_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    KeystoreRamFV_Result_t result =
+        {KeystoreRamFV_ERR_INVALID_PARAMETER, noIndex(key_store)};
+
+    if (key == NULL || appId > KeystoreRamFV_MAX_APP_ID ||
+        dataSize > KeystoreRamFV_KEY_DATA_SIZE)
+    {
+        return result;
+    }
+
+    unsigned long c = 0;
+    while (c < key_store->nrChunks && 0 == key_store->chunks[c].keyStore.freeSlots)
+    {
+        c++;
+    }
+
+    // the chunk the key goes to checks for it itself
+    KeystoreRamFV_Result_t found = {KeystoreRamFV_ERR_NOT_FOUND, 0};
+    if (findChunk(key_store, appId, key->name, c, &found) < key_store->nrChunks)
+    {
+        result.error = (KeystoreRamFV_ERR_NONE == found.error) ?
+                       KeystoreRamFV_ERR_DUPLICATED : found.error;
+        return result;
+    }
+
+    if (c == key_store->nrChunks)
+    {
+        result.error = growChunks(key_store);
+        if (KeystoreRamFV_ERR_NONE != result.error)
+        {
+            return result;
+        }
+    }
+
+    result = KeystoreRamFV_addWithSize(&key_store->chunks[c].keyStore, appId, key, dataSize);
+    result.index = (KeystoreRamFV_ERR_NONE == result.error) ?
+                   c * key_store->chunkElements + result.index : noIndex(key_store);
+
+    return result;
+}
+
+unsigned int
+KeystoreRamFVGrowable_delete(
+    KeystoreRamFVGrowable_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    if (name == NULL || appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    KeystoreRamFV_Result_t found = {KeystoreRamFV_ERR_NOT_FOUND, 0};
+    unsigned long c = findChunk(key_store, appId, name, key_store->nrChunks, &found);
+
+    if (c == key_store->nrChunks || KeystoreRamFV_ERR_NONE != found.error)
+    {
+        return found.error;
+    }
+
+    return KeystoreRamFV_deleteByIndex(&key_store->chunks[c].keyStore, appId, found.index);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_get(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    return lookupKey(key_store, appId, name, key, NULL);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_getWithSize(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    if (dataSize == NULL)
+    {
+        KeystoreRamFV_Result_t result =
+            {KeystoreRamFV_ERR_INVALID_PARAMETER, noIndex(key_store)};
+        return result;
+    }
+
+    return lookupKey(key_store, appId, name, key, dataSize);
+}
+
+unsigned int
+KeystoreRamFVGrowable_getByIndex(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    return lookupIndex(key_store, appId, index, key, NULL);
+}
+
+unsigned int
+KeystoreRamFVGrowable_getByIndexWithSize(
+    KeystoreRamFVGrowable_t const *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    if (dataSize == NULL)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    return lookupIndex(key_store, appId, index, key, dataSize);
+}
+
+unsigned long
+KeystoreRamFVGrowable_getFreeSlots(KeystoreRamFVGrowable_t const *key_store)
+{
+    unsigned long free_slots = 0;
+
+    for (unsigned long c = 0; c < key_store->nrChunks; c++)
+    {
+        free_slots += key_store->chunks[c].keyStore.freeSlots;
+    }
+
+    return free_slots;
+}
+
+#ifdef __cplusplus
+}
+#endif
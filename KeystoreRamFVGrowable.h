@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#include "KeystoreRamFV.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * A store that grows and shrinks in chunks of chunkElements elements instead
+ * of having a fixed capacity. Each chunk is a store of its own, whose memory
+ * is asked for with grow() when an add finds all chunks full: the function
+ * fills in the configuration of chunk number chunk, whose maxElements is set
+ * already, and returns KeystoreRamFV_ERR_NONE, or anything else if there is
+ * no more memory, which makes the add fail with KeystoreRamFV_ERR_OUT_OF_SPACE.
+ * Chunks without keys at the end of the chain are wiped and given back with
+ * shrink() by KeystoreRamFVGrowable_shrink(). A chunk given by grow() whose
+ * configuration is refused is given back with shrink() right away.
+ *
+ * Keys never move between chunks, so the index of a key, which is
+ * chunk * chunkElements + its index in the chunk, stays valid until the key
+ * is deleted. Lookups ask one chunk after the other, so they take as long as
+ * in one store of the same capacity. A growable store holds no read only keys.
+ */
+typedef unsigned int (*KeystoreRamFVGrowable_Grow_t)(
+    void *context,
+    unsigned long chunk,
+    KeystoreRamFV_Config_t *config);
+
+typedef void (*KeystoreRamFVGrowable_Shrink_t)(
+    void *context,
+    unsigned long chunk,
+    KeystoreRamFV_Config_t const *config);
+
+typedef struct KeystoreRamFVGrowable_Chunk {
+    KeystoreRamFV_t keyStore;
+    KeystoreRamFV_Config_t config;
+} KeystoreRamFVGrowable_Chunk_t;
+
+typedef struct KeystoreRamFVGrowable {
+    KeystoreRamFVGrowable_Chunk_t *chunks;
+    unsigned long maxChunks;
+    unsigned long nrChunks;
+    unsigned long chunkElements;
+    KeystoreRamFVGrowable_Grow_t grow;
+    KeystoreRamFVGrowable_Shrink_t shrink; /* NULL to keep all chunks */
+    void *context;
+} KeystoreRamFVGrowable_t;
+
+typedef struct KeystoreRamFVGrowable_Config {
+    KeystoreRamFVGrowable_Chunk_t *chunks; /* maxChunks of them */
+    unsigned long maxChunks;
+    unsigned long chunkElements;
+    KeystoreRamFVGrowable_Grow_t grow;
+    KeystoreRamFVGrowable_Shrink_t shrink;
+    void *context;
+} KeystoreRamFVGrowable_Config_t;
+
+/* starts without chunks, the first one is asked for by the first add */
+unsigned int
+KeystoreRamFVGrowable_init(
+    KeystoreRamFVGrowable_t *keyStore,
+    KeystoreRamFVGrowable_Config_t const *config);
+
+void
+KeystoreRamFVGrowable_wipe(
+    KeystoreRamFVGrowable_t *keyStore);
+
+/* returns the number of chunks given back */
+unsigned long
+KeystoreRamFVGrowable_shrink(
+    KeystoreRamFVGrowable_t *keyStore);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_add(
+    KeystoreRamFVGrowable_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_addWithSize(
+    KeystoreRamFVGrowable_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize);
+
+unsigned int
+KeystoreRamFVGrowable_delete(
+    KeystoreRamFVGrowable_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_get(
+    KeystoreRamFVGrowable_t const *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVGrowable_getWithSize(
+    KeystoreRamFVGrowable_t const *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+unsigned int
+KeystoreRamFVGrowable_getByIndex(
+    KeystoreRamFVGrowable_t const *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key);
+
+unsigned int
+KeystoreRamFVGrowable_getByIndexWithSize(
+    KeystoreRamFVGrowable_t const *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+/* of all chunks there are */
+unsigned long
+KeystoreRamFVGrowable_getFreeSlots(
+    KeystoreRamFVGrowable_t const *keyStore);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+extern "C"
+{
+#include "KeystoreRamFV.h"
+}
+
+/**
+ * Generates a KeystoreRamFV_ReadOnlySegment_t at compile time from a table of
+ * read only keys. Declared constexpr at namespace scope, the segment with its
+ * keys and its perfect hash ends up in constant memory:
+ *
+ *     constexpr KeystoreRamFV_SegmentKey_t provisioned[] = {
+ *         KeystoreRamFV_segmentKey(1, "rootKey", "\x01\x02\x03"),
+ *         KeystoreRamFV_segmentKey(2, "deviceKey", "\x04\x05"),
+ *     };
+ *     constexpr KeystoreRamFVSegment<2> segment(provisioned);
+ *
+ *     config.readOnlySegment = segment.get();
+ *
+ * A key of an app id above KeystoreRamFV_MAX_APP_ID, which could never be
+ * found, a duplicated key, or a table for which no perfect hash is found,
+ * makes the constant evaluation and thus the build fail.
+ */
+
+template <std::size_t NameLength, std::size_t DataLength>
+constexpr KeystoreRamFV_SegmentKey_t
+KeystoreRamFV_segmentKey(
+    unsigned int appId,
+    char const (&name)[NameLength],
+    char const (&data)[DataLength])
+{
+    static_assert(NameLength - 1 <= KeystoreRamFV_KEY_NAME_SIZE, "name too long");
+    static_assert(DataLength - 1 <= KeystoreRamFV_KEY_DATA_SIZE, "data too long");
+
+    if (appId > KeystoreRamFV_MAX_APP_ID)
+    {
+        throw std::invalid_argument("app id of a read only key too large");
+    }
+
+    KeystoreRamFV_SegmentKey_t segment_key{};
+
+    segment_key.appId = appId;
+    segment_key.key.readOnly = 1;
+    for (std::size_t k = 0; k + 1 < NameLength; k++)
+    {
+        segment_key.key.name[k] = name[k];
+    }
+    for (std::size_t k = 0; k + 1 < DataLength; k++)
+    {
+        segment_key.key.data[k] = data[k];
+    }
+
+    return segment_key;
+}
+
+
+template <std::size_t NrKeys>
+class KeystoreRamFVSegment
+{
+    static_assert(NrKeys > 0, "a segment needs keys");
+
+    public:
+    // about two keys per bucket, and a table filled up to one half at most
+    static constexpr std::size_t NR_BUCKETS = NrKeys / 2 + 1;
+    static constexpr std::size_t TABLE_SIZE = 2 * NrKeys + 1;
+    static constexpr unsigned long MAX_SEED = 1UL << 16;
+
+    constexpr explicit KeystoreRamFVSegment(
+        KeystoreRamFV_SegmentKey_t const (&keys)[NrKeys])
+    {
+        // the keys grouped by bucket: those of bucket b are bucket_keys[i]
+        // for bucket_start[b] <= i < bucket_start[b + 1]
+        std::array<std::size_t, NR_BUCKETS + 1> bucket_start{};
+        std::array<std::size_t, NrKeys> bucket_keys{};
+
+        for (std::size_t i = 0; i < NrKeys; i++)
+        {
+            // also for keys not made with KeystoreRamFV_segmentKey()
+            if (keys[i].appId > KeystoreRamFV_MAX_APP_ID)
+            {
+                throw std::invalid_argument("app id of a read only key too large");
+            }
+
+            keys_[i] = keys[i];
+            hashes_[i] = hashKey(keys[i].appId, keys[i].key.name);
+            bucket_start[hashes_[i] % NR_BUCKETS + 1]++;
+        }
+
+        for (std::size_t bucket = 0; bucket < NR_BUCKETS; bucket++)
+        {
+            bucket_start[bucket + 1] += bucket_start[bucket];
+        }
+
+        std::array<std::size_t, NR_BUCKETS> bucket_fill{};
+
+        for (std::size_t i = 0; i < NrKeys; i++)
+        {
+            std::size_t bucket = hashes_[i] % NR_BUCKETS;
+
+            bucket_keys[bucket_start[bucket] + bucket_fill[bucket]++] = i;
+        }
+
+        // a duplicate has the same hash, so it is in the same bucket
+        for (std::size_t bucket = 0; bucket < NR_BUCKETS; bucket++)
+        {
+            for (std::size_t i = bucket_start[bucket]; i < bucket_start[bucket + 1]; i++)
+            {
+                for (std::size_t j = bucket_start[bucket]; j < i; j++)
+                {
+                    KeystoreRamFV_SegmentKey_t const &a = keys[bucket_keys[i]];
+                    KeystoreRamFV_SegmentKey_t const &b = keys[bucket_keys[j]];
+
+                    if (a.appId == b.appId && sameName(a.key.name, b.key.name))
+                    {
+                        throw std::invalid_argument("duplicated read only key");
+                    }
+                }
+            }
+        }
+
+        // the largest buckets are placed first, while the table is emptiest,
+        // in an order from a counting sort over the sizes of the buckets
+        std::array<std::size_t, NrKeys + 2> size_start{};
+        std::array<std::size_t, NR_BUCKETS> order{};
+
+        for (std::size_t bucket = 0; bucket < NR_BUCKETS; bucket++)
+        {
+            size_start[NrKeys - bucketSize(bucket_start, bucket) + 1]++;
+        }
+
+        for (std::size_t rank = 0; rank <= NrKeys; rank++)
+        {
+            size_start[rank + 1] += size_start[rank];
+        }
+
+        for (std::size_t bucket = 0; bucket < NR_BUCKETS; bucket++)
+        {
+            order[size_start[NrKeys - bucketSize(bucket_start, bucket)]++] = bucket;
+        }
+
+        for (std::size_t slot = 0; slot < TABLE_SIZE; slot++)
+        {
+            table_[slot] = NrKeys;
+        }
+
+        for (std::size_t bucket : order)
+        {
+            placeBucket(
+                bucket,
+                bucket_keys.data() + bucket_start[bucket],
+                bucket_keys.data() + bucket_start[bucket + 1]);
+        }
+
+        segment_.nrKeys = NrKeys;
+        segment_.keys = keys_.data();
+        segment_.nrBuckets = NR_BUCKETS;
+        segment_.seeds = seeds_.data();
+        segment_.tableSize = TABLE_SIZE;
+        segment_.table = table_.data();
+    }
+
+    // the segment points into this object, which must therefore stay in place
+    KeystoreRamFVSegment(KeystoreRamFVSegment const &) = delete;
+    KeystoreRamFVSegment &operator=(KeystoreRamFVSegment const &) = delete;
+
+    constexpr KeystoreRamFV_ReadOnlySegment_t const *
+    get() const
+    {
+        return &segment_;
+    }
+
+    private:
+    // the same hash as the one of the store
+    static constexpr unsigned long
+    hashKey(unsigned int appId, char const (&name)[KeystoreRamFV_KEY_NAME_SIZE])
+    {
+        unsigned long hash = 2166136261UL;
+
+        hash = ((hash ^ (appId & 0xff)) * 16777619UL) & 0xffffffffUL;
+        for (std::size_t k = 0; k < KeystoreRamFV_KEY_NAME_SIZE; k++)
+        {
+            hash = ((hash ^ static_cast<unsigned char>(name[k])) * 16777619UL) & 0xffffffffUL;
+        }
+
+        return hash;
+    }
+
+    static constexpr bool
+    sameName(
+        char const (&a)[KeystoreRamFV_KEY_NAME_SIZE],
+        char const (&b)[KeystoreRamFV_KEY_NAME_SIZE])
+    {
+        for (std::size_t k = 0; k < KeystoreRamFV_KEY_NAME_SIZE; k++)
+        {
+            if (a[k] != b[k])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static constexpr std::size_t
+    bucketSize(
+        std::array<std::size_t, NR_BUCKETS + 1> const &bucket_start,
+        std::size_t bucket)
+    {
+        return bucket_start[bucket + 1] - bucket_start[bucket];
+    }
+
+    // Tries seeds until all keys of the bucket, from first to last, get an
+    // empty slot of their own, so each seed only touches the bucket's keys.
+    constexpr void
+    placeBucket(
+        std::size_t bucket,
+        std::size_t const *first,
+        std::size_t const *last)
+    {
+        for (unsigned long seed = 0; seed < MAX_SEED; seed++)
+        {
+            std::size_t const *key = first;
+
+            for (; key != last; key++)
+            {
+                std::size_t slot =
+                    KeystoreRamFV_SEGMENT_SLOT(hashes_[*key], seed, TABLE_SIZE);
+                if (NrKeys != table_[slot])
+                {
+                    break;
+                }
+
+                table_[slot] = *key;
+            }
+
+            if (last == key)
+            {
+                seeds_[bucket] = seed;
+                return;
+            }
+
+            // take back what was placed with this seed
+            for (std::size_t const *placed = first; placed != key; placed++)
+            {
+                table_[KeystoreRamFV_SEGMENT_SLOT(hashes_[*placed], seed, TABLE_SIZE)] = NrKeys;
+            }
+        }
+
+        throw std::length_error("no perfect hash found for the read only keys");
+    }
+
+    std::array<KeystoreRamFV_SegmentKey_t, NrKeys> keys_{};
+    std::array<unsigned long, NrKeys> hashes_{};
+    std::array<unsigned long, NR_BUCKETS> seeds_{};
+    std::array<unsigned long, TABLE_SIZE> table_{};
+    KeystoreRamFV_ReadOnlySegment_t segment_{};
+};
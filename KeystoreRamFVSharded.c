@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#include "KeystoreRamFVSharded.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+static KeystoreRamFVConcurrent_t *
+shardOf(KeystoreRamFVSharded_t const *key_store, unsigned int appId)
+{
+    return &key_store->shards[appId % key_store->nrShards];
+}
+
+
+unsigned int
+KeystoreRamFVSharded_init(
+    KeystoreRamFVSharded_t *key_store,
+    KeystoreRamFVConcurrent_t *shards,
+    KeystoreRamFVSharded_ShardConfig_t const *shardConfigs,
+    unsigned long nr_shards)
+{
+    if (shards == NULL || shardConfigs == NULL || 0 == nr_shards)
+    {
+        return KeystoreRamFV_ERR_INVALID_PARAMETER;
+    }
+
+    for (unsigned long s = 0; s < nr_shards; s++)
+    {
+        for (unsigned long k = 0; k < shardConfigs[s].nrKeys; k++)
+        {
+            if (shardConfigs[s].appIds[k] % nr_shards != s)
+            {
+                return KeystoreRamFV_ERR_INVALID_PARAMETER;
+            }
+        }
+    }
+
+    key_store->nrShards = nr_shards;
+    key_store->shards = shards;
+
+    unsigned int result = KeystoreRamFV_ERR_NONE;
+
+    for (unsigned long s = 0; s < nr_shards; s++)
+    {
+        unsigned int shard_result = KeystoreRamFVConcurrent_init(
+                                        &shards[s],
+                                        &shardConfigs[s].config,
+                                        shardConfigs[s].appIds,
+                                        shardConfigs[s].keys,
+                                        shardConfigs[s].nrKeys);
+
+        if (KeystoreRamFV_ERR_NONE == result)
+        {
+            result = shard_result;
+        }
+    }
+
+    return result;
+}
+
+void
+KeystoreRamFVSharded_wipe(KeystoreRamFVSharded_t *key_store)
+{
+    for (unsigned long s = 0; s < key_store->nrShards; s++)
+    {
+        KeystoreRamFVConcurrent_wipe(&key_store->shards[s]);
+    }
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_add(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key)
+{
+    return KeystoreRamFVConcurrent_add(shardOf(key_store, appId), appId, key);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_addWithSize(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize)
+{
+    return KeystoreRamFVConcurrent_addWithSize(
+               shardOf(key_store, appId),
+               appId,
+               key,
+               dataSize);
+}
+
+unsigned int
+KeystoreRamFVSharded_delete(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE])
+{
+    return KeystoreRamFVConcurrent_delete(shardOf(key_store, appId), appId, name);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_get(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    return KeystoreRamFVConcurrent_get(shardOf(key_store, appId), appId, name, key);
+}
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_getWithSize(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    return KeystoreRamFVConcurrent_getWithSize(
+               shardOf(key_store, appId),
+               appId,
+               name,
+               key,
+               dataSize);
+}
+
+unsigned int
+KeystoreRamFVSharded_getByIndex(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key)
+{
+    return KeystoreRamFVConcurrent_getByIndex(
+               shardOf(key_store, appId),
+               appId,
+               index,
+               key);
+}
+
+unsigned int
+KeystoreRamFVSharded_getByIndexWithSize(
+    KeystoreRamFVSharded_t *key_store,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize)
+{
+    return KeystoreRamFVConcurrent_getByIndexWithSize(
+               shardOf(key_store, appId),
+               appId,
+               index,
+               key,
+               dataSize);
+}
+
+void
+KeystoreRamFVSharded_getStats(
+    KeystoreRamFVSharded_t *key_store,
+    KeystoreRamFVSharded_Stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    stats->maxElements = 0;
+    stats->freeSlots = 0;
+    stats->readOnlySlots = 0;
+    stats->minFreeSlots = 0;
+    stats->fullestShard = 0;
+
+    for (unsigned long s = 0; s < key_store->nrShards; s++)
+    {
+        KeystoreRamFVConcurrent_t *shard = &key_store->shards[s];
+        unsigned long free_slots = KeystoreRamFVConcurrent_getFreeSlots(shard);
+
+        // neither changes after init
+        stats->maxElements += shard->keyStore.maxElements;
+        stats->readOnlySlots += shard->keyStore.readOnlySlots;
+        stats->freeSlots += free_slots;
+
+        if (0 == s || free_slots < stats->minFreeSlots)
+        {
+            stats->minFreeSlots = free_slots;
+            stats->fullestShard = s;
+        }
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#pragma once
+
+#include "KeystoreRamFVConcurrent.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * A store made of nrShards independent concurrent stores. The keys of appId
+ * are kept in shard appId % nrShards, so applications in different shards
+ * never contend for a lock or a cache line. Each shard has its own elements
+ * and capacity: adding to a full shard fails with
+ * KeystoreRamFV_ERR_OUT_OF_SPACE even if other shards have room. The indices
+ * of keys are those within their shard, which is known from the appId. The
+ * functions behave like those of KeystoreRamFVConcurrent.
+ */
+typedef struct KeystoreRamFVSharded {
+    unsigned long nrShards;
+    KeystoreRamFVConcurrent_t *shards;
+} KeystoreRamFVSharded_t;
+
+/* the configuration and the read only keys of one shard */
+typedef struct KeystoreRamFVSharded_ShardConfig {
+    KeystoreRamFV_Config_t config;
+    unsigned int const *appIds; /* all have to belong to the shard */
+    KeystoreRamFV_KeyRecord_t const *keys;
+    unsigned long nrKeys;
+} KeystoreRamFVSharded_ShardConfig_t;
+
+typedef struct KeystoreRamFVSharded_Stats {
+    unsigned long maxElements;   /* of all shards */
+    unsigned long freeSlots;     /* of all shards */
+    unsigned long readOnlySlots; /* of all shards */
+    unsigned long minFreeSlots;  /* of the fullest shard */
+    unsigned long fullestShard;
+} KeystoreRamFVSharded_Stats_t;
+
+/* not thread safe, no other call may be in progress */
+unsigned int
+KeystoreRamFVSharded_init(
+    KeystoreRamFVSharded_t *keyStore,
+    KeystoreRamFVConcurrent_t *shards,
+    KeystoreRamFVSharded_ShardConfig_t const *shardConfigs,
+    unsigned long nrShards);
+
+void
+KeystoreRamFVSharded_wipe(
+    KeystoreRamFVSharded_t *keyStore);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_add(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_addWithSize(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    KeystoreRamFV_KeyRecord_t const *key,
+    unsigned long dataSize);
+
+unsigned int
+KeystoreRamFVSharded_delete(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE]);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_get(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key);
+
+KeystoreRamFV_Result_t
+KeystoreRamFVSharded_getWithSize(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    const char name [KeystoreRamFV_KEY_NAME_SIZE],
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+unsigned int
+KeystoreRamFVSharded_getByIndex(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key);
+
+unsigned int
+KeystoreRamFVSharded_getByIndexWithSize(
+    KeystoreRamFVSharded_t *keyStore,
+    unsigned int appId,
+    unsigned long index,
+    KeystoreRamFV_KeyRecord_t *key,
+    unsigned long *dataSize);
+
+/* the counts of each shard are taken at one point, but not all at the same */
+void
+KeystoreRamFVSharded_getStats(
+    KeystoreRamFVSharded_t *keyStore,
+    KeystoreRamFVSharded_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,704 @@
+/*
+ *  Copyright (C) 2021, HENSOLDT Cyber GmbH
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include "../KeystoreRamFV.h"
+}
+#include "../KeystoreRamFVSharded.h"
+
+/* the scan kernel KeystoreRamFV.c was built with, see bench.sh */
+#if !defined(KeystoreRamFV_BENCH_KERNEL)
+#   define KeystoreRamFV_BENCH_KERNEL "default"
+#endif
+
+/*
+ * Measures the latency of each KeystoreRamFV operation across store sizes,
+ * fill ratios, hit ratios and app id distributions, and prints the results
+ * as JSON, laid out like the output of Google Benchmark:
+ *
+ *     { "context": {...}, "benchmarks": [ {"name": ..., ...}, ... ] }
+ *
+ * Lookups of Zipf distributed keys compare scans in the order of adding with
+ * scans in an order adapted to the lookups. Lookups and modifications from
+ * several threads compare a sharded store with a single concurrent store of
+ * the same capacity, by the throughput of all threads together.
+ *
+ * Options:
+ *     --quick  only stores of up to 1024 elements
+ *     --all    also stores without index beyond 4096 elements, which take
+ *              long to fill
+ */
+
+
+typedef std::chrono::steady_clock Clock;
+
+static const double BUDGET_NS = 20e6;   /* per benchmark */
+static const unsigned long MAX_ITERATIONS = 100000;
+static const unsigned long MIN_ITERATIONS = 16;
+
+enum Variant
+{
+    PLAIN,        /* linear scans only */
+    SPLIT,        /* linear scans over the names of a split store */
+    FINGERPRINTS, /* linear scans over fingerprints */
+    INDEXED,      /* index, free map and fingerprints */
+    ADAPTIVE      /* linear scans, hot keys moved to the front */
+};
+
+static const char *variant_names[] = {"plain", "split", "fingerprints", "indexed", "adaptive"};
+static const char *app_id_names[] = {"single", "uniform"};
+
+
+static KeystoreRamFV_KeyRecord_t make_key(unsigned int app_id, unsigned long k)
+{
+    KeystoreRamFV_KeyRecord_t key_record;
+
+    // masked to 4 and 8 digits, which the key numbers of all stores fit in,
+    // so the name is never truncated
+    memset(&key_record, 0, sizeof(key_record));
+    snprintf(key_record.name, KeystoreRamFV_KEY_NAME_SIZE, "%04x:%08lx", app_id & 0xffff, k & 0xffffffffUL);
+    memset(key_record.data, (int) k, 32);
+
+    return key_record;
+}
+
+
+class BenchStore
+{
+    public:
+    BenchStore(unsigned int size, Variant variant, bool uniform_app_ids) :
+        elements(variant == SPLIT ? 0 : size),
+        split_store(variant == SPLIT ? KeystoreRamFV_SPLIT_STORE_SIZE(size) / sizeof(unsigned long) + 1 : 0),
+        index_entries(KeystoreRamFV_INDEX_SIZE(size)),
+        free_map(KeystoreRamFV_FREE_MAP_SIZE(size)),
+        fingerprints(KeystoreRamFV_FINGERPRINTS_SIZE(size)),
+        hit_counters(KeystoreRamFV_HIT_COUNTERS_SIZE(size)),
+        uniform(uniform_app_ids)
+    {
+        config = KeystoreRamFV_Config_t();
+        config.maxElements = size;
+        config.elementStore = (variant == SPLIT) ? NULL : &elements[0];
+        config.splitStore = (variant == SPLIT) ? &split_store[0] : NULL;
+        if (variant == FINGERPRINTS || variant == INDEXED)
+        {
+            config.fingerprints = &fingerprints[0];
+        }
+        if (variant == INDEXED)
+        {
+            config.indexSize = index_entries.size();
+            config.indexStore = &index_entries[0];
+            config.freeMap = &free_map[0];
+        }
+        if (variant == ADAPTIVE)
+        {
+            config.hitCounters = &hit_counters[0];
+        }
+
+        KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0);
+    }
+
+    unsigned int size() const { return config.maxElements; }
+
+    // Key number k is in the store if k < nr_keys after fill(nr_keys).
+    unsigned int app_id(unsigned long k) const { return uniform ? k % (KeystoreRamFV_MAX_APP_ID + 1) : 0; }
+
+    KeystoreRamFV_KeyRecord_t key(unsigned long k) const { return make_key(app_id(k), k); }
+
+    void fill(unsigned long nr_keys)
+    {
+        KeystoreRamFV_wipe(&key_store);
+        for (unsigned long k = 0; k < nr_keys; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = key(k);
+            KeystoreRamFV_add(&key_store, app_id(k), &key_record);
+        }
+    }
+
+    KeystoreRamFV_t key_store;
+    KeystoreRamFV_Config_t config;
+    std::vector<KeystoreRamFV_ElementRecord_t> elements;
+    std::vector<unsigned long> split_store;
+    std::vector<KeystoreRamFV_IndexEntry_t> index_entries;
+    std::vector<unsigned long> free_map;
+    std::vector<unsigned char> fingerprints;
+    std::vector<unsigned int> hit_counters;
+    bool uniform;
+};
+
+
+struct Benchmark
+{
+    std::string operation;
+    Variant variant;
+    unsigned int size;
+    double fill;
+    double hit_ratio;
+    bool uniform;
+    std::vector<double> latencies;
+    double mean_probes = -1; /* elements scanned per lookup, if known */
+};
+
+
+class Random
+{
+    public:
+    unsigned long next()
+    {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        return seed >> 33;
+    }
+
+    bool chance(double ratio) { return (next() % 1000000) < ratio * 1000000; }
+
+    double uniform() { return (double) next() / (double) (1UL << 31); }
+
+    private:
+    unsigned long seed = 4711;
+};
+
+
+static double timer_overhead_ns = 0;
+
+// Runs op(iteration) until the budget is spent and records the latency of
+// each call. prepare(iteration) runs before each call and is not timed.
+template <typename Prepare, typename Op>
+static void measure(Benchmark &benchmark, Prepare prepare, Op op)
+{
+    double spent = 0;
+
+    for (unsigned long l = 0; l < MAX_ITERATIONS && (l < MIN_ITERATIONS || spent < BUDGET_NS); ++l)
+    {
+        prepare(l);
+
+        auto start = Clock::now();
+        op(l);
+        auto stop = Clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+        spent += ns;
+        benchmark.latencies.push_back(std::max(0.0, ns - timer_overhead_ns));
+    }
+}
+
+
+static void calibrate_timer()
+{
+    std::vector<double> samples;
+
+    for (unsigned int l = 0; l < 10000; ++l)
+    {
+        auto start = Clock::now();
+        auto stop = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    timer_overhead_ns = samples[samples.size() / 2];
+}
+
+
+static void print_benchmark(Benchmark &benchmark, bool &first)
+{
+    std::vector<double> &latencies = benchmark.latencies;
+    std::sort(latencies.begin(), latencies.end());
+
+    double total = 0;
+    for (double latency : latencies)
+    {
+        total += latency;
+    }
+
+    unsigned long n = latencies.size();
+    double mean = total / n;
+
+    printf("%s    {\n", first ? "" : ",\n");
+    printf("      \"name\": \"%s/%s/size:%u/fill:%.2f/hit:%.2f/apps:%s\",\n",
+           benchmark.operation.c_str(), variant_names[benchmark.variant], benchmark.size,
+           benchmark.fill, benchmark.hit_ratio, app_id_names[benchmark.uniform]);
+    printf("      \"operation\": \"%s\",\n", benchmark.operation.c_str());
+    printf("      \"variant\": \"%s\",\n", variant_names[benchmark.variant]);
+    printf("      \"size\": %u,\n", benchmark.size);
+    printf("      \"fill\": %.2f,\n", benchmark.fill);
+    printf("      \"hitRatio\": %.2f,\n", benchmark.hit_ratio);
+    printf("      \"appIds\": \"%s\",\n", app_id_names[benchmark.uniform]);
+    if (benchmark.mean_probes >= 0)
+    {
+        printf("      \"meanProbes\": %.1f,\n", benchmark.mean_probes);
+    }
+    printf("      \"iterations\": %lu,\n", n);
+    printf("      \"opsPerSecond\": %.1f,\n", (mean > 0) ? 1e9 / mean : 0.0);
+    printf("      \"meanNs\": %.1f,\n", mean);
+    printf("      \"p50Ns\": %.1f,\n", latencies[n / 2]);
+    printf("      \"p99Ns\": %.1f,\n", latencies[(n * 99) / 100]);
+    printf("      \"maxNs\": %.1f\n", latencies[n - 1]);
+    printf("    }");
+    fflush(stdout);
+    first = false;
+}
+
+
+// Benchmarks the operations on a store of the given geometry, filled with
+// nr_keys keys. Every operation leaves the store as it found it.
+static void bench_store(BenchStore &store, Variant variant, double fill, bool &first)
+{
+    unsigned int size = store.size();
+    unsigned long nr_keys = (unsigned long) (fill * size);
+    const double hit_ratios[] = {0.0, 0.5, 1.0};
+    Random random;
+
+    store.fill(nr_keys);
+
+    for (double hit_ratio : hit_ratios)
+    {
+        std::vector<KeystoreRamFV_KeyRecord_t> keys(MAX_ITERATIONS < 4 * size ? MAX_ITERATIONS : 4 * size);
+        std::vector<unsigned long> numbers(keys.size());
+        for (unsigned long l = 0; l < keys.size(); ++l)
+        {
+            numbers[l] = (random.chance(hit_ratio) && nr_keys > 0) ? random.next() % nr_keys : nr_keys + l;
+            keys[l] = store.key(numbers[l]);
+        }
+
+        Benchmark get = {"get", variant, size, fill, hit_ratio, store.uniform, {}};
+        KeystoreRamFV_KeyRecord_t found_key;
+        measure(get,
+                [](unsigned long) {},
+                [&](unsigned long l)
+                {
+                    unsigned long k = l % keys.size();
+                    KeystoreRamFV_get(&store.key_store, store.app_id(numbers[k]), keys[k].name, &found_key);
+                });
+        print_benchmark(get, first);
+
+        // elements below nr_keys are occupied after the fill
+        Benchmark get_by_index = {"getByIndex", variant, size, fill, hit_ratio, store.uniform, {}};
+        measure(get_by_index,
+                [](unsigned long) {},
+                [&](unsigned long l)
+                {
+                    unsigned long k = l % keys.size();
+                    unsigned long index = (numbers[k] < nr_keys) ? numbers[k] : nr_keys + numbers[k] % (size - nr_keys);
+                    KeystoreRamFV_getByIndex(&store.key_store, store.app_id(numbers[k]), index, &found_key);
+                });
+        print_benchmark(get_by_index, first);
+
+        // a deleted key is added again, untimed
+        Benchmark del = {"delete", variant, size, fill, hit_ratio, store.uniform, {}};
+        unsigned long deleted = nr_keys;
+        measure(del,
+                [&](unsigned long l)
+                {
+                    if (deleted < nr_keys)
+                    {
+                        KeystoreRamFV_KeyRecord_t key_record = store.key(deleted);
+                        KeystoreRamFV_add(&store.key_store, store.app_id(deleted), &key_record);
+                    }
+                    deleted = numbers[l % keys.size()];
+                },
+                [&](unsigned long)
+                {
+                    KeystoreRamFV_delete(&store.key_store, store.app_id(deleted), store.key(deleted).name);
+                });
+        if (deleted < nr_keys)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = store.key(deleted);
+            KeystoreRamFV_add(&store.key_store, store.app_id(deleted), &key_record);
+        }
+        print_benchmark(del, first);
+    }
+
+    // an added key is deleted again, untimed
+    if (nr_keys < size)
+    {
+        Benchmark add = {"add", variant, size, fill, 0.0, store.uniform, {}};
+        unsigned long added = nr_keys;
+        KeystoreRamFV_KeyRecord_t key_record;
+        measure(add,
+                [&](unsigned long l)
+                {
+                    if (l > 0)
+                    {
+                        KeystoreRamFV_delete(&store.key_store, store.app_id(added), key_record.name);
+                    }
+                    added = nr_keys + l;
+                    key_record = store.key(added);
+                },
+                [&](unsigned long)
+                {
+                    KeystoreRamFV_add(&store.key_store, store.app_id(added), &key_record);
+                });
+        KeystoreRamFV_delete(&store.key_store, store.app_id(added), key_record.name);
+        print_benchmark(add, first);
+    }
+
+    Benchmark wipe = {"wipe", variant, size, fill, 1.0, store.uniform, {}};
+    measure(wipe,
+            [&](unsigned long l)
+            {
+                if (l > 0)
+                {
+                    store.fill(nr_keys);
+                }
+            },
+            [&](unsigned long)
+            {
+                KeystoreRamFV_wipe(&store.key_store);
+            });
+    print_benchmark(wipe, first);
+
+    Benchmark init = {"init", variant, size, fill, 0.0, store.uniform, {}};
+    measure(init,
+            [](unsigned long) {},
+            [&](unsigned long)
+            {
+                KeystoreRamFV_initWithConfig(&store.key_store, &store.config, NULL, NULL, 0);
+            });
+    print_benchmark(init, first);
+
+    std::vector<unsigned int> app_ids(nr_keys);
+    std::vector<KeystoreRamFV_KeyRecord_t> keys(nr_keys);
+    for (unsigned long k = 0; k < nr_keys; ++k)
+    {
+        app_ids[k] = store.app_id(k);
+        keys[k] = store.key(k);
+    }
+
+    Benchmark init_read_only = {"initWithReadOnlyKeys", variant, size, fill, 0.0, store.uniform, {}};
+    measure(init_read_only,
+            [](unsigned long) {},
+            [&](unsigned long)
+            {
+                KeystoreRamFV_initWithConfig(&store.key_store, &store.config, &app_ids[0], &keys[0], nr_keys);
+            });
+    print_benchmark(init_read_only, first);
+
+    // wipe leaves read only keys in place
+    KeystoreRamFV_initWithConfig(&store.key_store, &store.config, NULL, NULL, 0);
+}
+
+
+// Looks up keys of a store filled to 95% with Zipf distributed popularity,
+// exponent 1, the popular keys spread over the store. The adaptive variant
+// calls KeystoreRamFV_adapt() every ADAPT_INTERVAL lookups, untimed, after as
+// many warm up lookups as are measured at most. Without fingerprints, a scan
+// looks at index + 1 elements to find a key, which gives meanProbes.
+static const unsigned long ADAPT_INTERVAL = 1024;
+
+static void bench_zipf(unsigned int size, Variant variant, bool &first)
+{
+    BenchStore store(size, variant, false);
+    unsigned long nr_keys = (unsigned long) (0.95 * size);
+    Random random;
+
+    store.fill(nr_keys);
+
+    // rank r is key number popular[r]
+    std::vector<unsigned long> popular(nr_keys);
+    for (unsigned long k = 0; k < nr_keys; ++k)
+    {
+        popular[k] = k;
+    }
+    for (unsigned long k = nr_keys - 1; k > 0; --k)
+    {
+        std::swap(popular[k], popular[random.next() % (k + 1)]);
+    }
+
+    std::vector<double> cumulative(nr_keys);
+    double total = 0;
+    for (unsigned long r = 0; r < nr_keys; ++r)
+    {
+        total += 1.0 / (r + 1);
+        cumulative[r] = total;
+    }
+
+    std::vector<KeystoreRamFV_KeyRecord_t> keys(MAX_ITERATIONS);
+    for (KeystoreRamFV_KeyRecord_t &key_record : keys)
+    {
+        unsigned long r = std::lower_bound(cumulative.begin(), cumulative.end(), random.uniform() * total) -
+                          cumulative.begin();
+        key_record = store.key(popular[std::min(r, nr_keys - 1)]);
+    }
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    for (unsigned long l = 0; l < keys.size(); ++l)
+    {
+        KeystoreRamFV_get(&store.key_store, 0, keys[l].name, &found_key);
+        if (variant == ADAPTIVE && (l + 1) % ADAPT_INTERVAL == 0)
+        {
+            KeystoreRamFV_adapt(&store.key_store, 1, NULL, NULL);
+        }
+    }
+
+    Benchmark get = {"getZipf", variant, size, 0.95, 1.0, false, {}};
+    double probes = 0;
+    measure(get,
+            [&](unsigned long l)
+            {
+                if (variant == ADAPTIVE && l > 0 && l % ADAPT_INTERVAL == 0)
+                {
+                    KeystoreRamFV_adapt(&store.key_store, 1, NULL, NULL);
+                }
+            },
+            [&](unsigned long l)
+            {
+                probes += KeystoreRamFV_get(&store.key_store, 0, keys[l].name, &found_key).index + 1;
+            });
+    get.mean_probes = probes / get.latencies.size();
+    print_benchmark(get, first);
+}
+
+
+// A sharded store of size elements in nr_shards shards, each with index, free
+// map and fingerprints; with one shard, it is a single concurrent store.
+class ThreadBenchStore
+{
+    public:
+    ThreadBenchStore(unsigned int size, unsigned int nr_shards) :
+        elements(size),
+        index_entries(nr_shards * KeystoreRamFV_INDEX_SIZE(size / nr_shards)),
+        free_map(nr_shards * KeystoreRamFV_FREE_MAP_SIZE(size / nr_shards)),
+        fingerprints(KeystoreRamFV_FINGERPRINTS_SIZE(size)),
+        shards(nr_shards),
+        shard_configs(nr_shards)
+    {
+        unsigned int shard_size = size / nr_shards;
+
+        for (unsigned int s = 0; s < nr_shards; ++s)
+        {
+            KeystoreRamFV_Config_t &config = shard_configs[s].config;
+
+            config = KeystoreRamFV_Config_t();
+            config.maxElements = shard_size;
+            config.elementStore = &elements[s * shard_size];
+            config.indexSize = KeystoreRamFV_INDEX_SIZE(shard_size);
+            config.indexStore = &index_entries[s * config.indexSize];
+            config.freeMap = &free_map[s * KeystoreRamFV_FREE_MAP_SIZE(shard_size)];
+            config.fingerprints = &fingerprints[s * shard_size];
+            shard_configs[s].appIds = NULL;
+            shard_configs[s].keys = NULL;
+            shard_configs[s].nrKeys = 0;
+        }
+
+        KeystoreRamFVSharded_init(&key_store, &shards[0], &shard_configs[0], nr_shards);
+    }
+
+    KeystoreRamFVSharded_t key_store;
+    std::vector<KeystoreRamFV_ElementRecord_t> elements;
+    std::vector<KeystoreRamFV_IndexEntry_t> index_entries;
+    std::vector<unsigned long> free_map;
+    std::vector<unsigned char> fingerprints;
+    std::vector<KeystoreRamFVConcurrent_t> shards;
+    std::vector<KeystoreRamFVSharded_ShardConfig_t> shard_configs;
+};
+
+
+struct ThroughputBenchmark
+{
+    std::string operation;
+    unsigned int size;
+    unsigned int nr_shards;
+    unsigned int nr_threads;
+    double write_ratio;
+    unsigned long operations; /* of all threads */
+    double ns;                /* that all threads ran */
+};
+
+
+static void print_throughput(ThroughputBenchmark const &benchmark, bool &first)
+{
+    double ops_per_second = benchmark.operations * 1e9 / benchmark.ns;
+    const char *variant = (benchmark.nr_shards > 1) ? "sharded" : "concurrent";
+
+    printf("%s    {\n", first ? "" : ",\n");
+    printf("      \"name\": \"%s/%s/size:%u/shards:%u/threads:%u/write:%.2f\",\n",
+           benchmark.operation.c_str(), variant, benchmark.size, benchmark.nr_shards,
+           benchmark.nr_threads, benchmark.write_ratio);
+    printf("      \"operation\": \"%s\",\n", benchmark.operation.c_str());
+    printf("      \"variant\": \"%s\",\n", variant);
+    printf("      \"size\": %u,\n", benchmark.size);
+    printf("      \"shards\": %u,\n", benchmark.nr_shards);
+    printf("      \"threads\": %u,\n", benchmark.nr_threads);
+    printf("      \"writeRatio\": %.2f,\n", benchmark.write_ratio);
+    printf("      \"iterations\": %lu,\n", benchmark.operations);
+    printf("      \"opsPerSecond\": %.1f,\n", ops_per_second);
+    printf("      \"meanNs\": %.1f\n", benchmark.nr_threads * 1e9 / ops_per_second);
+    printf("    }");
+    fflush(stdout);
+    first = false;
+}
+
+
+// Lets nr_threads threads look up and, with write_ratio, delete and add again
+// keys of their own app id for a while, thread t using app id t. With as many
+// shards as threads, each thread has a shard of its own.
+static const unsigned long THREAD_KEYS = 32;   /* per thread */
+static const double THREAD_BUDGET_NS = 100e6; /* per benchmark */
+
+static void bench_threads(unsigned int size, unsigned int nr_shards, unsigned int nr_threads, double write_ratio, bool &first)
+{
+    ThreadBenchStore store(size, nr_shards);
+
+    for (unsigned int t = 0; t < nr_threads; ++t)
+    {
+        for (unsigned long k = 0; k < THREAD_KEYS; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = make_key(t, k);
+            KeystoreRamFVSharded_add(&store.key_store, t, &key_record);
+        }
+    }
+
+    std::atomic<bool> running(false);
+    std::atomic<bool> stopped(false);
+    std::vector<unsigned long> operations(nr_threads);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < nr_threads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            Random random;
+            KeystoreRamFV_KeyRecord_t found_key;
+            unsigned long done = 0;
+
+            while (!running.load())
+            {
+            }
+
+            while (!stopped.load(std::memory_order_relaxed))
+            {
+                KeystoreRamFV_KeyRecord_t key_record = make_key(t, random.next() % THREAD_KEYS);
+
+                if (write_ratio > 0 && random.chance(write_ratio))
+                {
+                    KeystoreRamFVSharded_delete(&store.key_store, t, key_record.name);
+                    KeystoreRamFVSharded_add(&store.key_store, t, &key_record);
+                }
+                else
+                {
+                    KeystoreRamFVSharded_get(&store.key_store, t, key_record.name, &found_key);
+                }
+                done++;
+            }
+
+            operations[t] = done;
+        });
+    }
+
+    auto start = Clock::now();
+    running.store(true);
+    std::this_thread::sleep_for(std::chrono::nanoseconds((long) THREAD_BUDGET_NS));
+    stopped.store(true);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    auto stop = Clock::now();
+
+    ThroughputBenchmark benchmark = {write_ratio > 0 ? "mixThreads" : "getThreads", size, nr_shards, nr_threads, write_ratio, 0, 0};
+    for (unsigned long done : operations)
+    {
+        benchmark.operations += done;
+    }
+    benchmark.ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    print_throughput(benchmark, first);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int max_size = 65536;
+    unsigned int max_plain_size = 4096;
+
+    for (int k = 1; k < argc; ++k)
+    {
+        if (0 == strcmp(argv[k], "--quick"))
+        {
+            max_size = 1024;
+        }
+        else if (0 == strcmp(argv[k], "--all"))
+        {
+            max_plain_size = max_size;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--all]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    calibrate_timer();
+
+    printf("{\n");
+    printf("  \"context\": {\n");
+    printf("    \"kernel\": \"%s\",\n", KeystoreRamFV_BENCH_KERNEL);
+    printf("    \"keyNameSize\": %d,\n", KeystoreRamFV_KEY_NAME_SIZE);
+    printf("    \"keyDataSize\": %d,\n", KeystoreRamFV_KEY_DATA_SIZE);
+    printf("    \"hardwareThreads\": %u,\n", std::thread::hardware_concurrency());
+    printf("    \"timerOverheadNs\": %.1f\n", timer_overhead_ns);
+    printf("  },\n");
+    printf("  \"benchmarks\": [\n");
+
+    bool first = true;
+    const double fills[] = {0.5, 0.95};
+
+    for (unsigned int size = 16; size <= max_size; size *= 4)
+    {
+        for (int variant = PLAIN; variant <= INDEXED; ++variant)
+        {
+            if ((variant == PLAIN || variant == SPLIT) && size > max_plain_size)
+            {
+                continue;
+            }
+
+            for (int uniform = 0; uniform < 2; ++uniform)
+            {
+                BenchStore store(size, (Variant) variant, uniform);
+
+                for (double fill : fills)
+                {
+                    fprintf(stderr, "%s size %u fill %.2f apps %s\n",
+                            variant_names[variant], size, fill, app_id_names[uniform]);
+                    bench_store(store, (Variant) variant, fill, first);
+                }
+            }
+        }
+    }
+
+    for (unsigned int size = 64; size <= max_plain_size && size <= max_size; size *= 4)
+    {
+        for (Variant variant : {PLAIN, ADAPTIVE})
+        {
+            fprintf(stderr, "zipf %s size %u\n", variant_names[variant], size);
+            bench_zipf(size, variant, first);
+        }
+    }
+
+    // up to one thread per shard of the sharded store
+    const unsigned int max_threads = 8;
+    for (unsigned int nr_shards : {1u, max_threads})
+    {
+        for (double write_ratio : {0.0, 0.1})
+        {
+            for (unsigned int nr_threads = 1; nr_threads <= max_threads; nr_threads *= 2)
+            {
+                fprintf(stderr, "threads %u shards %u write %.2f\n", nr_threads, nr_shards, write_ratio);
+                bench_threads(1024, nr_shards, nr_threads, write_ratio, first);
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
@@ -5,7 +5,17 @@
 #include <gtest/gtest.h>
 #include <limits.h>
 #include <stdio.h>
-
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 extern "C"
@@ -13,6 +23,13 @@ extern "C"
 #include "../KeystoreRamFV.h"
 }
 
+#include "../KeystoreRamFV.hpp"
+#include "../KeystoreRamFVConcurrent.h"
+#include "../KeystoreRamFVFile.h"
+#include "../KeystoreRamFVGrowable.h"
+#include "../KeystoreRamFVSharded.h"
+#include "../KeystoreRamFVSegment.hpp"
+
 
 class Test_KeystoreRamFV : public testing::Test
 {
@@ -25,13 +42,37 @@ class KeyStore
     public:
     enum {NR_ELEMENTS = 16};
 
-    KeyStore(unsigned int size = NR_ELEMENTS) : keystore_elements(size) {}
+    KeyStore(unsigned int size = NR_ELEMENTS) :
+        keystore_elements(size),
+        index_entries(KeystoreRamFV_INDEX_SIZE(size)),
+        free_map(KeystoreRamFV_FREE_MAP_SIZE(size)),
+        fingerprints(KeystoreRamFV_FINGERPRINTS_SIZE(size)) {}
     unsigned int size() const { return keystore_elements.size(); }
     KeystoreRamFV_ElementRecord_t *get_element_buf() { return &keystore_elements[0]; }
+    unsigned char *get_fingerprints() { return &fingerprints[0]; }
     KeystoreRamFV_t *operator & () {return &key_store;}
 
+    KeystoreRamFV_Config_t get_config(bool accelerated = true)
+    {
+        KeystoreRamFV_Config_t config = {};
+
+        config.maxElements = size();
+        config.elementStore = get_element_buf();
+        if (accelerated)
+        {
+            config.indexSize = index_entries.size();
+            config.indexStore = &index_entries[0];
+            config.freeMap = &free_map[0];
+        }
+
+        return config;
+    }
+
     private:
     std::vector<KeystoreRamFV_ElementRecord_t> keystore_elements;
+    std::vector<KeystoreRamFV_IndexEntry_t> index_entries;
+    std::vector<unsigned long> free_map;
+    std::vector<unsigned char> fingerprints;
     KeystoreRamFV_t key_store;
 };
 
@@ -835,6 +876,2527 @@ TEST(Test_KeystoreRamFV, initialize_with_duplicate_read_only_keys_fails_properly
     }
 }
 
+
+// Expectation: initializing a Key Store with a read only key of an invalid
+// app id fails and leaves an empty Key Store, with or without an index.
+TEST(Test_KeystoreRamFV, initialize_with_read_only_key_of_invalid_app_id_fails)
+{
+    unsigned int app_ids[2] = {1, KeystoreRamFV_MAX_APP_ID + 45};
+    KeystoreRamFV_KeyRecord_t keys[2];
+    keys[0] = init_key_record(app_ids[0], 0);
+    keys[1] = init_key_record(app_ids[1], 1);
+
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store;
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, keys, 2));
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, app_ids[0], keys[0].name, &found_key).error);
+        ASSERT_EQ(key_store.size(), (&key_store)->freeSlots);
+    }
+}
+
+
+// Expectation: initializing a Key Store with an index that is too small fails.
+TEST(Test_KeystoreRamFV, init_with_too_small_index_fails)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.indexSize = KeystoreRamFV_INDEX_SIZE(key_store.size()) - 1;
+
+    unsigned int result = KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, result);
+}
+
+
+// Expectation: with an index, keys are found by name, and deleted keys are not found any more.
+TEST(Test_KeystoreRamFV, find_by_name_works_with_indexed_key_store)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    unsigned int init_result = KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, init_result);
+
+    for (unsigned int l = 0; l < key_store.size(); ++l)
+    {
+        unsigned int app_id = l % 3;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+        KeystoreRamFV_Result_t result = KeystoreRamFV_add(&key_store, app_id, &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(l, result.index);
+    }
+
+    for (unsigned int l = 0; l < key_store.size(); l += 2)
+    {
+        unsigned int app_id = l % 3;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+        int result = KeystoreRamFV_delete(&key_store, app_id, key.name);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result);
+    }
+
+    for (unsigned int l = 0; l < key_store.size(); ++l)
+    {
+        unsigned int app_id = l % 3;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        KeystoreRamFV_Result_t get_result = KeystoreRamFV_get(&key_store, app_id, key.name, &found_key);
+        if (l % 2 == 0)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, get_result.error);
+            continue;
+        }
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, get_result.error);
+        ASSERT_EQ(l, get_result.index);
+        ASSERT_EQ(0, compare_key_records(key, found_key));
+    }
+}
+
+
+// Applies the same pseudo random sequence of add, get, get_by_index, delete and
+// wipe calls to the given empty Key Store and to a plain one, comparing every result.
+// With deferred_wipe, the given Key Store is wiped deferred and scrubbed now and then.
+static
+void compare_with_plain_key_store(KeystoreRamFV_t *key_store, unsigned int size, bool deferred_wipe = false)
+{
+    KeyStore plain_key_store(size);
+
+    KeystoreRamFV_init(&plain_key_store, plain_key_store.size(), plain_key_store.get_element_buf());
+
+    unsigned long seed = 4711;
+    for (unsigned int l = 0; l < 20000; ++l)
+    {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        unsigned int operation = (seed >> 33) % 64;
+        unsigned int app_id = (seed >> 40) % 4;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, (seed >> 48) % (size * 3 / 4));
+
+        if (operation < 20)
+        {
+            KeystoreRamFV_Result_t expected = KeystoreRamFV_add(&plain_key_store, app_id, &key);
+            KeystoreRamFV_Result_t result = KeystoreRamFV_add(key_store, app_id, &key);
+            ASSERT_EQ(expected.error, result.error);
+            ASSERT_EQ(expected.index, result.index);
+        }
+        else if (operation < 40)
+        {
+            KeystoreRamFV_KeyRecord_t expected_key;
+            KeystoreRamFV_KeyRecord_t found_key;
+            KeystoreRamFV_Result_t expected = KeystoreRamFV_get(&plain_key_store, app_id, key.name, &expected_key);
+            KeystoreRamFV_Result_t result = KeystoreRamFV_get(key_store, app_id, key.name, &found_key);
+            ASSERT_EQ(expected.error, result.error);
+            ASSERT_EQ(expected.index, result.index);
+            if (KeystoreRamFV_ERR_NONE == result.error)
+            {
+                ASSERT_EQ(0, compare_key_records(expected_key, found_key));
+            }
+        }
+        else if (operation < 50)
+        {
+            unsigned long index = (seed >> 20) % (size + 1);
+            KeystoreRamFV_KeyRecord_t expected_key;
+            KeystoreRamFV_KeyRecord_t found_key;
+            unsigned int expected = KeystoreRamFV_getByIndex(&plain_key_store, app_id, index, &expected_key);
+            unsigned int result = KeystoreRamFV_getByIndex(key_store, app_id, index, &found_key);
+            ASSERT_EQ(expected, result);
+            if (KeystoreRamFV_ERR_NONE == result)
+            {
+                ASSERT_EQ(0, compare_key_records(expected_key, found_key));
+            }
+        }
+        else if (operation < 63)
+        {
+            unsigned int expected = KeystoreRamFV_delete(&plain_key_store, app_id, key.name);
+            unsigned int result = KeystoreRamFV_delete(key_store, app_id, key.name);
+            ASSERT_EQ(expected, result);
+        }
+        else if (0 == (seed >> 10) % 8)
+        {
+            KeystoreRamFV_wipe(&plain_key_store);
+            if (deferred_wipe)
+            {
+                KeystoreRamFV_wipeDeferred(key_store);
+            }
+            else
+            {
+                KeystoreRamFV_wipe(key_store);
+            }
+        }
+        else if (deferred_wipe)
+        {
+            KeystoreRamFV_scrubStep(key_store, (seed >> 10) % 8);
+        }
+    }
+}
+
+
+// Expectation: a Key Store with index and free map behaves exactly like one without.
+TEST(Test_KeystoreRamFV, accelerated_key_store_behaves_like_plain_key_store)
+{
+    KeyStore key_store(64);
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    compare_with_plain_key_store(&key_store, key_store.size());
+}
+
+
+// Expectation: a Key Store kept in a split store behaves exactly like one kept in
+// an array of element records, with and without index and free map.
+TEST(Test_KeystoreRamFV, split_key_store_behaves_like_plain_key_store)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(64);
+        std::vector<unsigned long> split_store(
+            KeystoreRamFV_SPLIT_STORE_SIZE(key_store.size()) / sizeof(unsigned long) + 1);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        config.elementStore = NULL;
+        config.splitStore = &split_store[0];
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        compare_with_plain_key_store(&key_store, key_store.size());
+    }
+}
+
+
+// Expectation: a Key Store cannot be both an array of element records and a split store.
+TEST(Test_KeystoreRamFV, init_with_two_element_stores_fails)
+{
+    KeyStore key_store;
+    std::vector<unsigned long> split_store(
+        KeystoreRamFV_SPLIT_STORE_SIZE(key_store.size()) / sizeof(unsigned long) + 1);
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.splitStore = &split_store[0];
+
+    unsigned int result = KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, result);
+}
+
+
+// Expectation: with an index, duplicate read only keys are detected and the Key Store is left empty.
+TEST(Test_KeystoreRamFV, initialize_indexed_key_store_with_duplicate_read_only_keys_fails_properly)
+{
+    KeyStore key_store;
+
+    unsigned int app_ids[3];
+    KeystoreRamFV_KeyRecord_t keys[3];
+
+    app_ids[0] = app_ids[1] = app_ids[2] = 1;
+    keys[0] = init_key_record(app_ids[0], 0);
+    keys[1] = init_key_record(app_ids[1], 1);
+    keys[2] = init_key_record(app_ids[2], 0);
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    unsigned int result = KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, keys, 3);
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, result);
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    KeystoreRamFV_Result_t get_result = KeystoreRamFV_get(&key_store, app_ids[1], keys[1].name, &found_key);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, get_result.error);
+
+    for (unsigned int l = 0; l < key_store.size(); ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_ids[0], l);
+        KeystoreRamFV_Result_t add_result = KeystoreRamFV_add(&key_store, app_ids[0], &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+    }
+}
+
+
+// Expectation: with a free map, the lowest free slot is still the one that gets reused.
+TEST(Test_KeystoreRamFV, free_map_reuses_lowest_free_slot)
+{
+    KeyStore key_store(200);
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.indexStore = NULL;
+    config.indexSize = 0;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    unsigned int app_id = 1;
+    for (unsigned int l = 0; l < key_store.size(); ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+        KeystoreRamFV_Result_t result = KeystoreRamFV_add(&key_store, app_id, &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(l, result.index);
+    }
+
+    KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, key_store.size());
+    KeystoreRamFV_Result_t add_result = KeystoreRamFV_add(&key_store, app_id, &key);
+    ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, add_result.error);
+
+    // free slots in different words of the free map, highest first
+    unsigned int deleted[] = {150, 70, 130, 3};
+    for (unsigned int l = 0; l < sizeof(deleted) / sizeof(deleted[0]); ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, deleted[l]);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, app_id, key.name));
+    }
+
+    unsigned int expected[] = {3, 70, 130, 150};
+    for (unsigned int l = 0; l < sizeof(expected) / sizeof(expected[0]); ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, key_store.size() + 1 + l);
+        KeystoreRamFV_Result_t result = KeystoreRamFV_add(&key_store, app_id, &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(expected[l], result.index);
+    }
+
+    add_result = KeystoreRamFV_add(&key_store, app_id, &key);
+    ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, add_result.error);
+}
+
+
+// Expectation: the length aware functions copy only the data in use, and the
+// fixed size functions see that data zero padded.
+TEST(Test_KeystoreRamFV, length_aware_add_and_get_copy_only_used_data)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_init(&key_store, key_store.size(), key_store.get_element_buf());
+
+    unsigned int app_id = 1;
+    unsigned long data_size = 32;
+    KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, 0);
+
+    KeystoreRamFV_Result_t add_result = KeystoreRamFV_addWithSize(&key_store, app_id, &key, KeystoreRamFV_KEY_DATA_SIZE + 1);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, add_result.error);
+
+    add_result = KeystoreRamFV_addWithSize(&key_store, app_id, &key, data_size);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    unsigned long found_size = 0;
+    memset(&found_key, 0x5a, sizeof(found_key));
+    KeystoreRamFV_Result_t get_result = KeystoreRamFV_getWithSize(&key_store, app_id, key.name, &found_key, &found_size);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, get_result.error);
+    ASSERT_EQ(data_size, found_size);
+    ASSERT_EQ(0, memcmp(key.name, found_key.name, KeystoreRamFV_KEY_NAME_SIZE));
+    ASSERT_EQ(0, memcmp(key.data, found_key.data, data_size));
+    for (unsigned int k = data_size; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        ASSERT_EQ(0x5a, (unsigned char) found_key.data[k]);
+    }
+
+    memset(&found_key, 0x5a, sizeof(found_key));
+    found_size = 0;
+    unsigned int result = KeystoreRamFV_getByIndexWithSize(&key_store, app_id, add_result.index, &found_key, &found_size);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, result);
+    ASSERT_EQ(data_size, found_size);
+    ASSERT_EQ(0, memcmp(key.data, found_key.data, data_size));
+
+    get_result = KeystoreRamFV_get(&key_store, app_id, key.name, &found_key);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, get_result.error);
+    ASSERT_EQ(0, memcmp(key.data, found_key.data, data_size));
+    for (unsigned int k = data_size; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        ASSERT_EQ(0, found_key.data[k]);
+    }
+
+    get_result = KeystoreRamFV_getWithSize(&key_store, app_id, key.name, &found_key, NULL);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, get_result.error);
+}
+
+
+// Expectation: deleting a key zeroes all of its data, whatever size it had, so a
+// shorter key added to the same slot later is still seen zero padded.
+TEST(Test_KeystoreRamFV, deleted_key_data_is_zeroed_for_any_size)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_init(&key_store, key_store.size(), key_store.get_element_buf());
+
+    unsigned int app_id = 1;
+    KeystoreRamFV_KeyRecord_t long_key = init_key_record(app_id, 1);
+    KeystoreRamFV_Result_t add_result = KeystoreRamFV_add(&key_store, app_id, &long_key);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, app_id, long_key.name));
+
+    KeystoreRamFV_ElementRecord_t const *element = &key_store.get_element_buf()[add_result.index];
+    for (unsigned int k = 0; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        ASSERT_EQ(0, element->key.data[k]);
+    }
+
+    KeystoreRamFV_KeyRecord_t short_key = init_key_record(app_id, 2);
+    KeystoreRamFV_Result_t short_add_result = KeystoreRamFV_addWithSize(&key_store, app_id, &short_key, 8);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, short_add_result.error);
+    ASSERT_EQ(add_result.index, short_add_result.index);
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    KeystoreRamFV_Result_t get_result = KeystoreRamFV_get(&key_store, app_id, short_key.name, &found_key);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, get_result.error);
+    ASSERT_EQ(0, memcmp(short_key.data, found_key.data, 8));
+    for (unsigned int k = 8; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        ASSERT_EQ(0, found_key.data[k]);
+    }
+
+    KeystoreRamFV_wipe(&key_store);
+    for (unsigned int k = 0; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        ASSERT_EQ(0, element->key.data[k]);
+    }
+}
+
+
+// Expectation: a borrowed view shows the key in place and becomes invalid once
+// the key is deleted, even if its slot is reused by a key of the same name.
+TEST(Test_KeystoreRamFV, borrowed_view_detects_deletion_and_reuse)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_init(&key_store, key_store.size(), key_store.get_element_buf());
+
+    unsigned int app_id = 1;
+    KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, 0);
+    KeystoreRamFV_Result_t add_result = KeystoreRamFV_addWithSize(&key_store, app_id, &key, 32);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+
+    KeystoreRamFV_KeyView_t view;
+    KeystoreRamFV_Result_t borrow_result = KeystoreRamFV_borrow(&key_store, app_id, key.name, &view);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, borrow_result.error);
+    ASSERT_EQ(add_result.index, borrow_result.index);
+    ASSERT_EQ(add_result.index, view.index);
+    ASSERT_EQ(32, view.dataSize);
+    ASSERT_EQ(0, view.readOnly);
+    ASSERT_EQ(0, memcmp(key.name, view.name, KeystoreRamFV_KEY_NAME_SIZE));
+    ASSERT_EQ(0, memcmp(key.data, view.data, 32));
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_isViewValid(&key_store, &view));
+
+    borrow_result = KeystoreRamFV_borrow(&key_store, app_id + 1, key.name, &view);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, borrow_result.error);
+    borrow_result = KeystoreRamFV_borrow(&key_store, app_id, key.name, NULL);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, borrow_result.error);
+
+    borrow_result = KeystoreRamFV_borrow(&key_store, app_id, key.name, &view);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, borrow_result.error);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, app_id, key.name));
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_isViewValid(&key_store, &view));
+
+    add_result = KeystoreRamFV_add(&key_store, app_id, &key);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+    ASSERT_EQ(view.index, add_result.index);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_isViewValid(&key_store, &view));
+
+    borrow_result = KeystoreRamFV_borrow(&key_store, app_id, key.name, &view);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, borrow_result.error);
+    KeystoreRamFV_wipe(&key_store);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_isViewValid(&key_store, &view));
+}
+
+
+// Expectation: batched add, get and delete give the same results as the single
+// calls applied one after the other, with and without index and free map.
+// Test method: run pseudo random batches, including repeated keys, unknown keys and
+// invalid app ids, against two Key Stores and compare every result.
+TEST(Test_KeystoreRamFV, batches_behave_like_single_calls)
+{
+    // more keys than fit into two windows of a batch
+    enum {BATCH_SIZE = 140};
+
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(32);
+        KeyStore single_key_store(32);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+        KeystoreRamFV_init(&single_key_store, single_key_store.size(), single_key_store.get_element_buf());
+
+        unsigned long seed = 815;
+        for (unsigned int l = 0; l < 2000; ++l)
+        {
+            unsigned int app_ids[BATCH_SIZE];
+            char names[BATCH_SIZE][KeystoreRamFV_KEY_NAME_SIZE];
+            std::vector<KeystoreRamFV_KeyRecord_t> keys(BATCH_SIZE);
+            std::vector<KeystoreRamFV_KeyRecord_t> found_keys(BATCH_SIZE);
+            KeystoreRamFV_Result_t results[BATCH_SIZE];
+
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            unsigned int operation = (seed >> 33) % 3;
+            unsigned long nr_keys = (seed >> 40) % (BATCH_SIZE + 1);
+
+            for (unsigned int i = 0; i < nr_keys; ++i)
+            {
+                seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+                app_ids[i] = ((seed >> 33) % 64 == 0) ? KeystoreRamFV_MAX_APP_ID + 1 : (seed >> 40) % 3;
+                keys[i] = init_key_record(app_ids[i], (seed >> 48) % 24);
+                memcpy(names[i], keys[i].name, KeystoreRamFV_KEY_NAME_SIZE);
+            }
+
+            if (0 == operation)
+            {
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_addBatch(&key_store, nr_keys, app_ids, &keys[0], results));
+                for (unsigned int i = 0; i < nr_keys; ++i)
+                {
+                    KeystoreRamFV_Result_t expected = KeystoreRamFV_add(&single_key_store, app_ids[i], &keys[i]);
+                    ASSERT_EQ(expected.error, results[i].error);
+                    ASSERT_EQ(expected.index, results[i].index);
+                }
+            }
+            else if (1 == operation)
+            {
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_getBatch(&key_store, nr_keys, app_ids, names, &found_keys[0], results));
+                for (unsigned int i = 0; i < nr_keys; ++i)
+                {
+                    KeystoreRamFV_KeyRecord_t expected_key;
+                    KeystoreRamFV_Result_t expected = KeystoreRamFV_get(&single_key_store, app_ids[i], names[i], &expected_key);
+                    ASSERT_EQ(expected.error, results[i].error);
+                    ASSERT_EQ(expected.index, results[i].index);
+                    if (KeystoreRamFV_ERR_NONE == expected.error)
+                    {
+                        ASSERT_EQ(0, compare_key_records(expected_key, found_keys[i]));
+                    }
+                }
+            }
+            else
+            {
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_deleteBatch(&key_store, nr_keys, app_ids, names, results));
+                for (unsigned int i = 0; i < nr_keys; ++i)
+                {
+                    unsigned int expected = KeystoreRamFV_delete(&single_key_store, app_ids[i], names[i]);
+                    ASSERT_EQ(expected, results[i].error);
+                }
+            }
+        }
+    }
+}
+
+
+// Expectation: batch calls reject missing arrays.
+TEST(Test_KeystoreRamFV, batches_catch_illegal_arguments)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_init(&key_store, key_store.size(), key_store.get_element_buf());
+
+    unsigned int app_ids[1] = {0};
+    KeystoreRamFV_KeyRecord_t keys[1] = {init_key_record(0, 0)};
+    char names[1][KeystoreRamFV_KEY_NAME_SIZE];
+    KeystoreRamFV_Result_t results[1];
+
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_addBatch(&key_store, 1, NULL, keys, results));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_addBatch(&key_store, 1, app_ids, keys, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_getBatch(&key_store, 1, app_ids, NULL, keys, results));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_getBatch(&key_store, 1, app_ids, names, NULL, results));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_deleteBatch(&key_store, 1, app_ids, NULL, results));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_deleteBatch(&key_store, 1, NULL, names, results));
+}
+
+
+// Expectation: iterating over the keys of an app id visits exactly its keys, once each.
+TEST(Test_KeystoreRamFV, iterator_visits_exactly_the_keys_of_an_app_id)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(40);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        for (unsigned int l = 0; l < key_store.size(); ++l)
+        {
+            unsigned int app_id = l % 4;
+            KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, app_id, &key).error);
+        }
+
+        for (unsigned int l = 0; l < key_store.size(); l += 3)
+        {
+            unsigned int app_id = l % 4;
+            KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, app_id, key.name));
+        }
+
+        for (unsigned int app_id = 0; app_id <= 4; ++app_id)
+        {
+            std::set<std::string> expected;
+            for (unsigned int l = 0; l < key_store.size(); ++l)
+            {
+                if (l % 4 == app_id && l % 3 != 0)
+                {
+                    KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+                    expected.insert(std::string(key.name, KeystoreRamFV_KEY_NAME_SIZE));
+                }
+            }
+
+            std::set<std::string> visited;
+            KeystoreRamFV_Iterator_t iterator;
+            KeystoreRamFV_KeyRecord_t found_key;
+            unsigned int result = KeystoreRamFV_first(&key_store, app_id, &iterator, &found_key);
+            while (KeystoreRamFV_ERR_NONE == result)
+            {
+                std::string name(iterator.name, KeystoreRamFV_KEY_NAME_SIZE);
+                ASSERT_TRUE(visited.insert(name).second);
+                ASSERT_EQ(0, memcmp(iterator.name, found_key.name, KeystoreRamFV_KEY_NAME_SIZE));
+
+                KeystoreRamFV_KeyRecord_t key;
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_getByIndex(&key_store, app_id, iterator.index, &key));
+                ASSERT_EQ(0, compare_key_records(key, found_key));
+
+                result = KeystoreRamFV_next(&key_store, &iterator, &found_key);
+            }
+
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, result);
+            ASSERT_TRUE(expected == visited);
+        }
+    }
+}
+
+
+// Expectation: iterating over names only works, and the current key may be deleted meanwhile.
+TEST(Test_KeystoreRamFV, iterator_allows_deleting_the_current_key)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_init(&key_store, key_store.size(), key_store.get_element_buf());
+
+    unsigned int app_id = 7;
+    for (unsigned int l = 0; l < key_store.size(); ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id + l % 2, l);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, app_id + l % 2, &key).error);
+    }
+
+    unsigned int deleted = 0;
+    KeystoreRamFV_Iterator_t iterator;
+    unsigned int result = KeystoreRamFV_first(&key_store, app_id, &iterator, NULL);
+    while (KeystoreRamFV_ERR_NONE == result)
+    {
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, app_id, iterator.name));
+        ++deleted;
+        result = KeystoreRamFV_next(&key_store, &iterator, NULL);
+    }
+
+    ASSERT_EQ(key_store.size() / 2, deleted);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_first(&key_store, app_id, &iterator, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_first(&key_store, app_id + 1, &iterator, NULL));
+
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_first(&key_store, KeystoreRamFV_MAX_APP_ID + 1, &iterator, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_first(&key_store, app_id, NULL, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_next(&key_store, NULL, NULL));
+}
+
+
+// Expectation: a Key Store wiped deferred behaves exactly like one wiped at once,
+// with and without index and free map, whether it is scrubbed or not.
+TEST(Test_KeystoreRamFV, deferred_wipe_behaves_like_wipe)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(64);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        compare_with_plain_key_store(&key_store, key_store.size(), true);
+    }
+}
+
+
+// Expectation: keys wiped deferred cannot be read in any way before they are
+// scrubbed, read only keys survive, and scrubbing zeroes all wiped elements.
+TEST(Test_KeystoreRamFV, deferred_wipe_hides_keys_until_scrubbed)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store;
+
+        unsigned int app_id = 2;
+        unsigned int app_ids[1] = {app_id};
+        KeystoreRamFV_KeyRecord_t read_only_keys[1] = {init_key_record(app_id, 100)};
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, read_only_keys, 1));
+
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, 0);
+        KeystoreRamFV_Result_t add_result = KeystoreRamFV_add(&key_store, app_id, &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+
+        KeystoreRamFV_KeyView_t view;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_borrow(&key_store, app_id, key.name, &view).error);
+
+        KeystoreRamFV_wipeDeferred(&key_store);
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, app_id, key.name, &found_key).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_getByIndex(&key_store, app_id, add_result.index, &found_key));
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_borrow(&key_store, app_id, key.name, &view).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_isViewValid(&key_store, &view));
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_delete(&key_store, app_id, key.name));
+
+        KeystoreRamFV_Iterator_t iterator;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_first(&key_store, app_id, &iterator, NULL));
+        ASSERT_EQ(0, memcmp(read_only_keys[0].name, iterator.name, KeystoreRamFV_KEY_NAME_SIZE));
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_next(&key_store, &iterator, NULL));
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, app_id, read_only_keys[0].name, &found_key).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, KeystoreRamFV_delete(&key_store, app_id, read_only_keys[0].name));
+
+        // the stale key material is still there until it is scrubbed
+        ASSERT_NE(0, key_store.get_element_buf()[add_result.index].key.name[0]);
+
+        ASSERT_NE(0, KeystoreRamFV_scrubStep(&key_store, 1));
+        ASSERT_EQ(0, KeystoreRamFV_scrubStep(&key_store, key_store.size()));
+
+        KeystoreRamFV_ElementRecord_t const *element = &key_store.get_element_buf()[add_result.index];
+        ASSERT_TRUE(element->admin.isFree);
+        for (unsigned int k = 0; k < KeystoreRamFV_KEY_NAME_SIZE; ++k)
+        {
+            ASSERT_EQ(0, element->key.name[k]);
+        }
+        for (unsigned int k = 0; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+        {
+            ASSERT_EQ(0, element->key.data[k]);
+        }
+
+        // all but the read only key fit into the store again
+        for (unsigned int l = 0; l + 1 < key_store.size(); ++l)
+        {
+            KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+            KeystoreRamFV_Result_t result = KeystoreRamFV_add(&key_store, app_id, &key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+            ASSERT_EQ(l + 1, result.index);
+        }
+        ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, KeystoreRamFV_add(&key_store, app_id, &key).error);
+    }
+}
+
+
+// Expectation: a lazily initialized store behaves like a plain one, also
+// when it is wiped deferred.
+TEST(Test_KeystoreRamFV, lazy_init_behaves_like_eager_init)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(64);
+        memset(key_store.get_element_buf(), 0xa5, key_store.size() * sizeof(KeystoreRamFV_ElementRecord_t));
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        config.lazyInit = 1;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        compare_with_plain_key_store(&key_store, key_store.size(), true);
+    }
+}
+
+
+// Expectation: lazy initialization does not touch elements that were never
+// used, and none of them can be read.
+TEST(Test_KeystoreRamFV, lazy_init_leaves_unused_elements_untouched)
+{
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store;
+        memset(key_store.get_element_buf(), 0xa5, key_store.size() * sizeof(KeystoreRamFV_ElementRecord_t));
+
+        unsigned int app_id = 3;
+        unsigned int app_ids[1] = {app_id};
+        KeystoreRamFV_KeyRecord_t read_only_keys[1] = {init_key_record(app_id, 100)};
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        config.lazyInit = 1;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, read_only_keys, 1));
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        for (unsigned int l = 1; l < key_store.size(); ++l)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_getByIndex(&key_store, app_id, l, &found_key));
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_getByIndex(&key_store, 0xa5a5a5a5 & KeystoreRamFV_MAX_APP_ID, l, &found_key));
+        }
+
+        const unsigned int nr_added = 3;
+        for (unsigned int l = 0; l < nr_added; ++l)
+        {
+            KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+            KeystoreRamFV_Result_t result = KeystoreRamFV_add(&key_store, app_id, &key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+            ASSERT_EQ(l + 1, result.index);
+        }
+
+        unsigned char const *unused = (unsigned char const *) &key_store.get_element_buf()[nr_added + 1];
+        for (unsigned int k = 0; k < (key_store.size() - nr_added - 1) * sizeof(KeystoreRamFV_ElementRecord_t); ++k)
+        {
+            ASSERT_EQ(0xa5, unused[k]);
+        }
+
+        KeystoreRamFV_wipe(&key_store);
+        ASSERT_EQ(0xa5, unused[0]);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, app_id, read_only_keys[0].name, &found_key).error);
+    }
+}
+
+
+// Expectation: a lazy reinitialization leaves the entries of the index as
+// they are, but none of the keys they point to can be found any more.
+TEST(Test_KeystoreRamFV, lazy_reinit_does_not_clear_the_index)
+{
+    KeyStore key_store(64);
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.lazyInit = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    for (unsigned int l = 0; l < 40; ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(l % 3, l);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, l % 3, &key).error);
+    }
+
+    std::vector<KeystoreRamFV_IndexEntry_t> table(config.indexStore, config.indexStore + config.indexSize - 1);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+    ASSERT_EQ(0, memcmp(&table[0], config.indexStore, table.size() * sizeof(table[0])));
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    for (unsigned int l = 0; l < 40; ++l)
+    {
+        KeystoreRamFV_KeyRecord_t key = init_key_record(l % 3, l);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, l % 3, key.name, &found_key).error);
+    }
+
+    compare_with_plain_key_store(&key_store, key_store.size());
+}
+
+
+// Expectation: a large set of read only keys is loaded completely, and a
+// single duplicate anywhere in it leaves an empty Key Store.
+TEST(Test_KeystoreRamFV, bulk_load_of_read_only_keys_detects_duplicates)
+{
+    const unsigned int nr_keys = 2000;
+
+    std::vector<unsigned int> app_ids(nr_keys);
+    std::vector<KeystoreRamFV_KeyRecord_t> keys(nr_keys);
+    for (unsigned int l = 0; l < nr_keys; ++l)
+    {
+        app_ids[l] = l % 7;
+        keys[l] = init_key_record(app_ids[l], l / 7);
+    }
+
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(nr_keys + 1);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, &app_ids[0], &keys[0], nr_keys));
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        for (unsigned int l = 0; l < nr_keys; ++l)
+        {
+            KeystoreRamFV_Result_t result = KeystoreRamFV_get(&key_store, app_ids[l], keys[l].name, &found_key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+            ASSERT_EQ(l, result.index);
+        }
+
+        // the same name with another app id is not a duplicate, the same pair is
+        std::vector<KeystoreRamFV_KeyRecord_t> duplicated_keys(keys);
+        duplicated_keys[nr_keys - 1] = keys[nr_keys / 2];
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, &app_ids[0], &duplicated_keys[0], nr_keys));
+
+        std::vector<unsigned int> duplicated_app_ids(app_ids);
+        duplicated_app_ids[nr_keys - 1] = app_ids[nr_keys / 2];
+        ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_initWithConfig(&key_store, &config, &duplicated_app_ids[0], &duplicated_keys[0], nr_keys));
+
+        for (unsigned int l = 0; l < nr_keys; ++l)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, app_ids[l], keys[l].name, &found_key).error);
+        }
+
+        for (unsigned int l = 0; l < key_store.size(); ++l)
+        {
+            KeystoreRamFV_KeyRecord_t key = init_key_record(0, l);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 0, &key).error);
+        }
+    }
+}
+
+
+static constexpr KeystoreRamFV_SegmentKey_t segment_keys[] = {
+    KeystoreRamFV_segmentKey(1, "rootKey", "\x01\x02\x03"),
+    KeystoreRamFV_segmentKey(1, "signingKey", "\x04\x00\x05"),
+    KeystoreRamFV_segmentKey(2, "rootKey", "\x06"),
+    KeystoreRamFV_segmentKey(2, "0123456789abcdef", "\x07\x08"),
+    KeystoreRamFV_segmentKey(3, "deviceKey", ""),
+    KeystoreRamFV_segmentKey(1, "wrappingKey", "\x09"),
+    KeystoreRamFV_segmentKey(255, "rootKey", "\x0a"),
+};
+static constexpr KeystoreRamFVSegment<sizeof(segment_keys) / sizeof(segment_keys[0])> segment(segment_keys);
+
+
+// Expectation: the keys of a read only segment can be read like other read
+// only keys, but take no element and clash with any key of the same name.
+TEST(Test_KeystoreRamFV, read_only_segment_keys_are_found_and_protected)
+{
+    const unsigned long nr_segment_keys = sizeof(segment_keys) / sizeof(segment_keys[0]);
+
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store;
+
+        unsigned int app_ids[1] = {1};
+        KeystoreRamFV_KeyRecord_t read_only_keys[1] = {segment_keys[0].key};
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        config.readOnlySegment = segment.get();
+        ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, read_only_keys, 1));
+
+        read_only_keys[0] = init_key_record(app_ids[0], 100);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, app_ids, read_only_keys, 1));
+
+        for (unsigned long l = 0; l < nr_segment_keys; ++l)
+        {
+            unsigned int app_id = segment_keys[l].appId;
+            char const *name = segment_keys[l].key.name;
+
+            KeystoreRamFV_KeyRecord_t found_key;
+            KeystoreRamFV_Result_t result = KeystoreRamFV_get(&key_store, app_id, name, &found_key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+            ASSERT_EQ(key_store.size() + 1 + l, result.index);
+            ASSERT_EQ(1, found_key.readOnly);
+            ASSERT_EQ(0, memcmp(&segment_keys[l].key, &found_key, sizeof(found_key)));
+
+            memset(&found_key, 0, sizeof(found_key));
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_getByIndex(&key_store, app_id, result.index, &found_key));
+            ASSERT_EQ(0, memcmp(&segment_keys[l].key, &found_key, sizeof(found_key)));
+            ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_getByIndex(&key_store, app_id ^ 4, result.index, &found_key));
+
+            KeystoreRamFV_KeyView_t view;
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_borrow(&key_store, app_id, name, &view).error);
+            ASSERT_EQ(segment.get()->keys[l].key.data, view.data);
+
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, app_id ^ 4, name, &found_key).error);
+            ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, KeystoreRamFV_delete(&key_store, app_id, name));
+            ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_add(&key_store, app_id, &segment_keys[l].key).error);
+
+            KeystoreRamFV_wipe(&key_store);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_isViewValid(&key_store, &view));
+        }
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_getByIndex(&key_store, 1, key_store.size() + 1 + nr_segment_keys, &found_key));
+
+        // the segment takes no element
+        for (unsigned int l = 1; l < key_store.size(); ++l)
+        {
+            KeystoreRamFV_KeyRecord_t key = init_key_record(1, l);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key).error);
+        }
+
+        std::set<std::string> names;
+        KeystoreRamFV_Iterator_t iterator;
+        for (unsigned int error = KeystoreRamFV_first(&key_store, 1, &iterator, NULL);
+             KeystoreRamFV_ERR_NONE == error;
+             error = KeystoreRamFV_next(&key_store, &iterator, NULL))
+        {
+            names.insert(std::string(iterator.name, KeystoreRamFV_KEY_NAME_SIZE));
+        }
+        ASSERT_EQ(key_store.size() + 3, names.size());
+        ASSERT_EQ(1, names.count(std::string(segment_keys[5].key.name, KeystoreRamFV_KEY_NAME_SIZE)));
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_next(&key_store, &iterator, NULL));
+
+        unsigned int batch_app_ids[3] = {2, 1, 2};
+        char batch_names[3][KeystoreRamFV_KEY_NAME_SIZE];
+        memcpy(batch_names[0], segment_keys[3].key.name, KeystoreRamFV_KEY_NAME_SIZE);
+        create_key_name(1, 1, batch_names[1]);
+        memcpy(batch_names[2], segment_keys[0].key.name, KeystoreRamFV_KEY_NAME_SIZE);
+        KeystoreRamFV_KeyRecord_t batch_keys[3];
+        KeystoreRamFV_Result_t batch_results[3];
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_getBatch(&key_store, 3, batch_app_ids, batch_names, batch_keys, batch_results));
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, batch_results[0].error);
+        ASSERT_EQ(key_store.size() + 4, batch_results[0].index);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, batch_results[1].error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, batch_results[2].error);
+        ASSERT_EQ(0, memcmp(&segment_keys[2].key, &batch_keys[2], sizeof(batch_keys[2])));
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_deleteBatch(&key_store, 3, batch_app_ids, batch_names, batch_results));
+        ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, batch_results[0].error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, batch_results[1].error);
+        ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, batch_results[2].error);
+    }
+}
+
+
+enum {NR_MANY_SEGMENT_KEYS = 400};
+
+struct ManySegmentKeys
+{
+    KeystoreRamFV_SegmentKey_t keys[NR_MANY_SEGMENT_KEYS];
+};
+
+// "many" and the number of the key in three digits, for five app ids
+static constexpr ManySegmentKeys
+make_many_segment_keys()
+{
+    ManySegmentKeys many{};
+
+    for (unsigned int l = 0; l < NR_MANY_SEGMENT_KEYS; ++l)
+    {
+        KeystoreRamFV_SegmentKey_t &segment_key = many.keys[l];
+        char const prefix[] = "many";
+
+        segment_key.appId = l % 5;
+        segment_key.key.readOnly = 1;
+        for (unsigned int k = 0; k < 4; ++k)
+        {
+            segment_key.key.name[k] = prefix[k];
+        }
+        segment_key.key.name[4] = static_cast<char>('0' + l / 100);
+        segment_key.key.name[5] = static_cast<char>('0' + l / 10 % 10);
+        segment_key.key.name[6] = static_cast<char>('0' + l % 10);
+        segment_key.key.data[0] = static_cast<char>(l);
+    }
+
+    return many;
+}
+
+static constexpr ManySegmentKeys many_segment_keys = make_many_segment_keys();
+static constexpr KeystoreRamFVSegment<NR_MANY_SEGMENT_KEYS> many_segment(many_segment_keys.keys);
+
+
+// Expectation: segment keys of app ids that could never be found are refused,
+// which fails the build when done in constant evaluation.
+TEST(Test_KeystoreRamFV, read_only_segment_refuses_invalid_app_ids)
+{
+    ASSERT_THROW(KeystoreRamFV_segmentKey(KeystoreRamFV_MAX_APP_ID + 1, "key", "data"), std::invalid_argument);
+
+    KeystoreRamFV_SegmentKey_t keys[2] = {
+        KeystoreRamFV_segmentKey(1, "key", "data"),
+        KeystoreRamFV_segmentKey(KeystoreRamFV_MAX_APP_ID, "key", "data"),
+    };
+    keys[1].appId = KeystoreRamFV_MAX_APP_ID + 1;
+    ASSERT_THROW(KeystoreRamFVSegment<2> invalid_segment(keys), std::invalid_argument);
+}
+
+// Expectation: a segment of some hundred keys is generated within the default
+// limits of constant evaluation, and each of its keys is found.
+TEST(Test_KeystoreRamFV, large_read_only_segment_is_generated_at_compile_time)
+{
+    KeyStore key_store;
+
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.readOnlySegment = many_segment.get();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    for (unsigned long l = 0; l < NR_MANY_SEGMENT_KEYS; ++l)
+    {
+        KeystoreRamFV_SegmentKey_t const &segment_key = many_segment_keys.keys[l];
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        KeystoreRamFV_Result_t result = KeystoreRamFV_get(&key_store, segment_key.appId, segment_key.key.name, &found_key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(key_store.size() + 1 + l, result.index);
+        ASSERT_EQ(0, memcmp(&segment_key.key, &found_key, sizeof(found_key)));
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, segment_key.appId + 5, segment_key.key.name, &found_key).error);
+    }
+}
+
+
+// Expectation: the C++ front end gives the same results as the C API.
+TEST(Test_KeystoreRamFV, template_key_store_behaves_like_c_key_store)
+{
+    using TemplateKeyStore = fv::KeystoreRamFV<64>;
+
+    KeyStore key_store(TemplateKeyStore::capacity());
+    auto template_key_store = std::make_unique<TemplateKeyStore>();
+
+    unsigned int app_ids[2] = {1, 2};
+    KeystoreRamFV_KeyRecord_t read_only_keys[2] = {init_key_record(1, 100), init_key_record(2, 100)};
+    TemplateKeyStore::ReadOnlyKey template_read_only_keys[2];
+    for (unsigned int k = 0; k < 2; ++k)
+    {
+        template_read_only_keys[k] = {
+            app_ids[k],
+            read_only_keys[k].name,
+            std::as_bytes(std::span(read_only_keys[k].data))};
+    }
+
+    KeystoreRamFV_initWithReadOnlyKeys(&key_store, app_ids, read_only_keys, 2, key_store.size(), key_store.get_element_buf());
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, template_key_store->initWithReadOnlyKeys(template_read_only_keys));
+
+    TemplateKeyStore::Record found_key;
+    unsigned long seed = 4711;
+    for (unsigned int l = 0; l < 20000; ++l)
+    {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        unsigned int operation = (seed >> 33) % 64;
+        unsigned int app_id = (seed >> 40) % 4;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, (seed >> 48) % 48);
+        unsigned long data_size = (seed >> 20) % (KeystoreRamFV_KEY_DATA_SIZE + 1);
+
+        if (operation < 20)
+        {
+            KeystoreRamFV_Result_t expected = KeystoreRamFV_addWithSize(&key_store, app_id, &key, data_size);
+            KeystoreRamFV_Result_t result = template_key_store->add(
+                app_id, key.name, std::as_bytes(std::span(key.data, data_size)));
+            ASSERT_EQ(expected.error, result.error);
+            ASSERT_EQ(expected.index, result.index);
+        }
+        else if (operation < 50)
+        {
+            KeystoreRamFV_KeyRecord_t expected_key;
+            unsigned long expected_size;
+            KeystoreRamFV_Result_t expected = (operation < 40) ?
+                KeystoreRamFV_getWithSize(&key_store, app_id, key.name, &expected_key, &expected_size) :
+                KeystoreRamFV_Result_t{
+                    KeystoreRamFV_getByIndexWithSize(&key_store, app_id, data_size % 66, &expected_key, &expected_size),
+                    data_size % 66};
+            KeystoreRamFV_Result_t result = (operation < 40) ?
+                template_key_store->get(app_id, key.name, found_key) :
+                KeystoreRamFV_Result_t{
+                    template_key_store->getByIndex(app_id, data_size % 66, found_key),
+                    data_size % 66};
+            ASSERT_EQ(expected.error, result.error);
+            ASSERT_EQ(expected.index, result.index);
+            if (KeystoreRamFV_ERR_NONE == result.error)
+            {
+                ASSERT_EQ(std::string(expected_key.name), std::string(found_key.name()));
+                ASSERT_EQ(expected_size, found_key.data().size());
+                ASSERT_EQ(0, memcmp(expected_key.data, found_key.data().data(), expected_size));
+                ASSERT_EQ(expected_key.readOnly != 0, found_key.readOnly());
+            }
+        }
+        else if (operation < 63)
+        {
+            unsigned int expected = KeystoreRamFV_delete(&key_store, app_id, key.name);
+            unsigned int result = template_key_store->remove(app_id, key.name);
+            ASSERT_EQ(expected, result);
+        }
+        else
+        {
+            KeystoreRamFV_wipe(&key_store);
+            template_key_store->wipe();
+        }
+    }
+}
+
+
+// Expectation: stores of different geometry coexist, check the sizes of names
+// and data, and records lose their key material when moved from.
+TEST(Test_KeystoreRamFV, template_key_stores_of_different_geometry)
+{
+    fv::KeystoreRamFV<4, 8, 32> small_key_store;
+    auto large_key_store = std::make_unique<fv::KeystoreRamFV<2, 64, 4096>>();
+
+    std::byte data[4096] = {std::byte{0x5a}};
+    std::string long_name(64, 'n');
+
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, small_key_store.add(1, "12345678", std::span(data, 32)).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, small_key_store.add(1, "123456789", std::span(data, 32)).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, small_key_store.add(1, "1234", std::span(data, 33)).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, large_key_store->add(1, long_name, data).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, large_key_store->add(1, long_name, data).error);
+
+    fv::KeystoreRamFV<2, 64, 4096>::Record large_key;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, large_key_store->get(1, long_name, large_key).error);
+    ASSERT_EQ(long_name, large_key.name());
+    ASSERT_EQ(4096u, large_key.data().size());
+
+    fv::KeystoreRamFV<4, 8, 32>::Record key;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, small_key_store.get(1, "12345678", key).error);
+    ASSERT_EQ("12345678", key.name());
+    ASSERT_EQ(std::byte{0x5a}, key.data()[0]);
+
+    fv::KeystoreRamFV<4, 8, 32>::Record moved_key(std::move(key));
+    ASSERT_EQ("12345678", moved_key.name());
+    ASSERT_EQ(32u, moved_key.data().size());
+    ASSERT_EQ(0u, key.data().size());
+    ASSERT_EQ("", key.name());
+
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, small_key_store.remove(1, "12345678"));
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, small_key_store.get(1, "12345678", key).error);
+    ASSERT_EQ(4u, small_key_store.freeSlots());
+}
+
+
+// The data of a key in the stress test is determined by its name and a
+// version kept in the first byte of data.
+static
+void fill_versioned_data(KeystoreRamFV_KeyRecord_t *key, unsigned char version)
+{
+    key->data[0] = version;
+    for (unsigned int k = 1; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        key->data[k] = (char) (version + key->name[k % KeystoreRamFV_KEY_NAME_SIZE] + k);
+    }
+}
+
+static
+bool has_versioned_data(KeystoreRamFV_KeyRecord_t const *key)
+{
+    for (unsigned int k = 1; k < KeystoreRamFV_KEY_DATA_SIZE; ++k)
+    {
+        if (key->data[k] != (char) (key->data[0] + key->name[k % KeystoreRamFV_KEY_NAME_SIZE] + k))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Expectation: a concurrent Key Store rejects anything that lookups write to.
+TEST(Test_KeystoreRamFV, concurrent_key_store_rejects_state_written_by_lookups)
+{
+    KeyStore key_store;
+    KeystoreRamFVConcurrent_t concurrent_key_store;
+
+    std::vector<unsigned int> hit_counters(KeystoreRamFV_HIT_COUNTERS_SIZE(key_store.size()));
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    config.hitCounters = &hit_counters[0];
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+
+    std::vector<KeystoreRamFV_CacheEntry_t> entries(4 * KeystoreRamFV_CACHE_WAYS);
+    KeystoreRamFV_LookupCache_t lookup_cache = {4, &entries[0], 0, 0};
+    config = key_store.get_config();
+    config.lookupCache = &lookup_cache;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+
+#if defined(KeystoreRamFV_STATISTICS)
+    KeystoreRamFV_Statistics_t statistics;
+    config = key_store.get_config();
+    config.statistics = &statistics;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+#endif
+#if defined(KeystoreRamFV_TIMING)
+    KeystoreRamFV_Timing_t timing;
+    config = key_store.get_config();
+    config.timing = &timing;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+#endif
+
+    config = key_store.get_config();
+    config.lazyInit = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+
+    config = key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, NULL, NULL, 0));
+}
+
+
+// Expectation: readers running in parallel with a writer never see a torn key,
+// and always find the keys that are not modified.
+TEST(Test_KeystoreRamFV, concurrent_readers_never_see_torn_keys)
+{
+    const unsigned int nr_readers = 3;
+    const unsigned int nr_writes = 20000;
+    const unsigned int app_id = 5;
+
+    for (int accelerated = 0; accelerated < 2; ++accelerated)
+    {
+        KeyStore key_store(32);
+        KeystoreRamFVConcurrent_t concurrent_key_store;
+
+        unsigned int app_ids[1] = {app_id};
+        KeystoreRamFV_KeyRecord_t read_only_keys[1] = {init_key_record(app_id, 100)};
+        fill_versioned_data(&read_only_keys[0], 7);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVConcurrent_init(&concurrent_key_store, &config, app_ids, read_only_keys, 1));
+
+        std::atomic<bool> done(false);
+        std::atomic<unsigned long> torn_keys(0);
+        std::atomic<unsigned long> lost_keys(0);
+        std::atomic<unsigned long> found_keys(0);
+
+        std::vector<std::thread> readers;
+        for (unsigned int r = 0; r < nr_readers; ++r)
+        {
+            readers.emplace_back([&, r]()
+            {
+                unsigned int l = r;
+                while (!done.load())
+                {
+                    KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l % 8);
+                    KeystoreRamFV_KeyRecord_t found_key;
+
+                    KeystoreRamFV_Result_t result = KeystoreRamFVConcurrent_get(&concurrent_key_store, app_id, key.name, &found_key);
+                    if (KeystoreRamFV_ERR_NONE == result.error)
+                    {
+                        found_keys++;
+                        if (0 != memcmp(key.name, found_key.name, KeystoreRamFV_KEY_NAME_SIZE) ||
+                            !has_versioned_data(&found_key))
+                        {
+                            torn_keys++;
+                        }
+                    }
+
+                    if (KeystoreRamFV_ERR_NONE == KeystoreRamFVConcurrent_getByIndex(&concurrent_key_store, app_id, l % 32, &found_key) &&
+                        !has_versioned_data(&found_key))
+                    {
+                        torn_keys++;
+                    }
+
+                    if (KeystoreRamFV_ERR_NONE != KeystoreRamFVConcurrent_get(&concurrent_key_store, app_id, read_only_keys[0].name, &found_key).error ||
+                        !has_versioned_data(&found_key))
+                    {
+                        lost_keys++;
+                    }
+
+                    l++;
+                }
+            });
+        }
+
+        for (unsigned int l = 0; l < nr_writes; ++l)
+        {
+            KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l % 8);
+            fill_versioned_data(&key, (unsigned char) (l / 8));
+
+            KeystoreRamFVConcurrent_delete(&concurrent_key_store, app_id, key.name);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVConcurrent_add(&concurrent_key_store, app_id, &key).error);
+
+            if (0 == l % 1000)
+            {
+                KeystoreRamFVConcurrent_wipe(&concurrent_key_store);
+            }
+        }
+
+        done.store(true);
+        for (auto &reader : readers)
+        {
+            reader.join();
+        }
+
+        ASSERT_EQ(0u, torn_keys.load());
+        ASSERT_EQ(0u, lost_keys.load());
+        ASSERT_LT(0u, found_keys.load());
+    }
+}
+
+
+// Expectation: a sharded Key Store keeps the keys of each app id in its own
+// shard, with the capacity of that shard, and sums up the shards in its stats.
+TEST(Test_KeystoreRamFV, sharded_key_store_limits_each_shard)
+{
+    const unsigned int nr_shards = 4;
+
+    std::vector<KeyStore> shard_stores(nr_shards);
+    std::vector<KeystoreRamFVConcurrent_t> shards(nr_shards);
+    std::vector<KeystoreRamFVSharded_ShardConfig_t> shard_configs(nr_shards);
+    for (unsigned int s = 0; s < nr_shards; ++s)
+    {
+        shard_configs[s] = KeystoreRamFVSharded_ShardConfig_t();
+        shard_configs[s].config = shard_stores[s].get_config(s % 2);
+    }
+
+    unsigned int app_ids[1] = {6};
+    KeystoreRamFV_KeyRecord_t read_only_keys[1] = {init_key_record(6, 100)};
+    shard_configs[1].appIds = app_ids;
+    shard_configs[1].keys = read_only_keys;
+    shard_configs[1].nrKeys = 1;
+
+    KeystoreRamFVSharded_t key_store;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVSharded_init(&key_store, &shards[0], &shard_configs[0], nr_shards));
+
+    shard_configs[1].appIds = NULL;
+    shard_configs[1].keys = NULL;
+    shard_configs[1].nrKeys = 0;
+    shard_configs[2].appIds = app_ids;
+    shard_configs[2].keys = read_only_keys;
+    shard_configs[2].nrKeys = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVSharded_init(&key_store, &shards[0], &shard_configs[0], nr_shards));
+
+    // app ids 1 and 5 share a shard, app id 2 does not
+    for (unsigned int l = 0; l < KeyStore::NR_ELEMENTS; ++l)
+    {
+        unsigned int app_id = (l % 2) ? 1 : 5;
+        KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l);
+        KeystoreRamFV_Result_t result = KeystoreRamFVSharded_add(&key_store, app_id, &key);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVSharded_getByIndex(&key_store, app_id, result.index, &found_key));
+        ASSERT_EQ(0, compare_key_records(key, found_key));
+    }
+
+    KeystoreRamFV_KeyRecord_t key = init_key_record(1, 1000);
+    ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, KeystoreRamFVSharded_add(&key_store, 1, &key).error);
+    key = init_key_record(2, 1000);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVSharded_add(&key_store, 2, &key).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFVSharded_get(&key_store, 6, key.name, &key).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, KeystoreRamFVSharded_delete(&key_store, 6, read_only_keys[0].name));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVSharded_add(&key_store, KeystoreRamFV_MAX_APP_ID + 1, &key).error);
+
+    KeystoreRamFVSharded_Stats_t stats;
+    KeystoreRamFVSharded_getStats(&key_store, &stats);
+    ASSERT_EQ(nr_shards * KeyStore::NR_ELEMENTS, stats.maxElements);
+    ASSERT_EQ(1u, stats.readOnlySlots);
+    ASSERT_EQ((nr_shards - 1) * KeyStore::NR_ELEMENTS - 2, stats.freeSlots);
+    ASSERT_EQ(0u, stats.minFreeSlots);
+    ASSERT_EQ(1u, stats.fullestShard);
+
+    KeystoreRamFVSharded_wipe(&key_store);
+    KeystoreRamFVSharded_getStats(&key_store, &stats);
+    ASSERT_EQ(nr_shards * KeyStore::NR_ELEMENTS - 1, stats.freeSlots);
+}
+
+
+// Expectation: threads working on the app ids of different shards do not
+// interfere with each other.
+TEST(Test_KeystoreRamFV, sharded_key_store_serves_threads_in_parallel)
+{
+    const unsigned int nr_shards = 4;
+
+    std::vector<KeyStore> shard_stores(nr_shards, KeyStore(64));
+    std::vector<KeystoreRamFVConcurrent_t> shards(nr_shards);
+    std::vector<KeystoreRamFVSharded_ShardConfig_t> shard_configs(nr_shards);
+    for (unsigned int s = 0; s < nr_shards; ++s)
+    {
+        shard_configs[s] = KeystoreRamFVSharded_ShardConfig_t();
+        shard_configs[s].config = shard_stores[s].get_config();
+    }
+
+    KeystoreRamFVSharded_t key_store;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVSharded_init(&key_store, &shards[0], &shard_configs[0], nr_shards));
+
+    std::atomic<unsigned long> failures(0);
+    std::vector<std::thread> threads;
+    for (unsigned int app_id = 0; app_id < 2 * nr_shards; ++app_id)
+    {
+        threads.emplace_back([&, app_id]()
+        {
+            for (unsigned int l = 0; l < 5000; ++l)
+            {
+                KeystoreRamFV_KeyRecord_t key = init_key_record(app_id, l % 16);
+                KeystoreRamFV_KeyRecord_t found_key;
+
+                if (KeystoreRamFV_ERR_NONE != KeystoreRamFVSharded_add(&key_store, app_id, &key).error ||
+                    KeystoreRamFV_ERR_NONE != KeystoreRamFVSharded_get(&key_store, app_id, key.name, &found_key).error ||
+                    0 != compare_key_records(key, found_key) ||
+                    KeystoreRamFV_ERR_NONE != KeystoreRamFVSharded_delete(&key_store, app_id, key.name))
+                {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    ASSERT_EQ(0u, failures.load());
+
+    KeystoreRamFVSharded_Stats_t stats;
+    KeystoreRamFVSharded_getStats(&key_store, &stats);
+    ASSERT_EQ(stats.maxElements, stats.freeSlots);
+}
+
+
+// Expectation: the scan finds each key at any position, also behind elements
+// with the same name under another app id or in a stale element, and does not
+// take names that differ in a single byte.
+TEST(Test_KeystoreRamFV, scan_finds_keys_at_any_position)
+{
+    for (int split = 0; split < 2; ++split)
+    {
+        KeyStore key_store(13);
+        std::vector<unsigned long> split_store(
+            KeystoreRamFV_SPLIT_STORE_SIZE(key_store.size()) / sizeof(unsigned long) + 1);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(false);
+        if (split)
+        {
+            config.elementStore = NULL;
+            config.splitStore = &split_store[0];
+        }
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        for (unsigned int position = 0; position < key_store.size(); ++position)
+        {
+            KeystoreRamFV_wipe(&key_store);
+
+            KeystoreRamFV_KeyRecord_t key = init_key_record(1, 0);
+            for (unsigned int l = 0; l < position; ++l)
+            {
+                // the same name, but under another app id, or the name
+                // differing in one byte
+                KeystoreRamFV_KeyRecord_t other_key = key;
+                other_key.name[l % KeystoreRamFV_KEY_NAME_SIZE] ^= (l % 3) ? 0x01 : 0x00;
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, (l % 3) ? 1 : 10 + l, &other_key).error);
+            }
+
+            // a stale element with the key's name precedes it
+            if (position > 0)
+            {
+                KeystoreRamFV_wipeDeferred(&key_store);
+                ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key.name, &key).error);
+                for (unsigned int l = 0; l < position; ++l)
+                {
+                    KeystoreRamFV_KeyRecord_t other_key = init_key_record(3, l);
+                    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 3, &other_key).error);
+                }
+            }
+
+            KeystoreRamFV_Result_t add_result = KeystoreRamFV_add(&key_store, 1, &key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, add_result.error);
+            ASSERT_EQ(position, add_result.index);
+
+            KeystoreRamFV_KeyRecord_t found_key;
+            KeystoreRamFV_Result_t get_result = KeystoreRamFV_get(&key_store, 1, key.name, &found_key);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, get_result.error);
+            ASSERT_EQ(position, get_result.index);
+
+            key.name[KeystoreRamFV_KEY_NAME_SIZE - 1] ^= 0x01;
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key.name, &found_key).error);
+        }
+    }
+}
+
+
+// Expectation: a Key Store with fingerprints behaves exactly like one without,
+// also in a split store and when wiped deferred, and the fingerprints of free
+// elements are 0.
+TEST(Test_KeystoreRamFV, fingerprinted_key_store_behaves_like_plain_key_store)
+{
+    for (int split = 0; split < 2; ++split)
+    {
+        KeyStore key_store(100);
+        std::vector<unsigned long> split_store(
+            KeystoreRamFV_SPLIT_STORE_SIZE(key_store.size()) / sizeof(unsigned long) + 1);
+
+        KeystoreRamFV_Config_t config = key_store.get_config(false);
+        config.fingerprints = key_store.get_fingerprints();
+        if (split)
+        {
+            config.elementStore = NULL;
+            config.splitStore = &split_store[0];
+        }
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        compare_with_plain_key_store(&key_store, key_store.size(), split);
+
+        KeystoreRamFV_wipe(&key_store);
+        KeystoreRamFV_KeyRecord_t key = init_key_record(1, 0);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key).error);
+        ASSERT_EQ(0x80, key_store.get_fingerprints()[0] & 0x80);
+        for (unsigned int l = 1; l < key_store.size(); ++l)
+        {
+            ASSERT_EQ(0, key_store.get_fingerprints()[l]);
+        }
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, 1, key.name));
+        ASSERT_EQ(0, key_store.get_fingerprints()[0]);
+    }
+}
+
+
+#if defined(KeystoreRamFV_STATISTICS)
+// Expectation: the statistics count calls, errors, scanned slots and copied
+// bytes of the operations, and can be read and reset.
+TEST(Test_KeystoreRamFV, statistics_count_what_operations_do)
+{
+    KeyStore key_store;
+    KeystoreRamFV_Statistics_t statistics = {};
+    KeystoreRamFV_Statistics_t snapshot;
+    KeystoreRamFV_Config_t config = key_store.get_config(false);
+    KeystoreRamFV_KeyRecord_t key_record;
+    unsigned int const not_found = 0 - KeystoreRamFV_ERR_NOT_FOUND;
+    unsigned int const duplicated = 0 - KeystoreRamFV_ERR_DUPLICATED;
+
+    config.statistics = &statistics;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    for (unsigned int k = 0; k < 4; ++k)
+    {
+        key_record = init_key_record(1, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+    }
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+
+    KeystoreRamFV_getStatistics(&key_store, &snapshot);
+    ASSERT_EQ(1u, snapshot.calls[KeystoreRamFV_OP_INIT]);
+    ASSERT_EQ(5u, snapshot.calls[KeystoreRamFV_OP_ADD]);
+    ASSERT_EQ(4u, snapshot.errors[KeystoreRamFV_OP_ADD][0]);
+    ASSERT_EQ(1u, snapshot.errors[KeystoreRamFV_OP_ADD][duplicated]);
+    ASSERT_EQ(4u * (KeystoreRamFV_KEY_NAME_SIZE + KeystoreRamFV_KEY_DATA_SIZE), snapshot.bytesCopied);
+    // init zeroes all elements
+    ASSERT_GE(snapshot.bytesZeroed, key_store.size() * (KeystoreRamFV_KEY_NAME_SIZE + KeystoreRamFV_KEY_DATA_SIZE));
+
+    KeystoreRamFV_resetStatistics(&key_store);
+    KeystoreRamFV_getStatistics(&key_store, &snapshot);
+    ASSERT_EQ(0u, snapshot.calls[KeystoreRamFV_OP_ADD]);
+    ASSERT_EQ(0u, snapshot.bytesCopied);
+
+    // a miss scans every element that may hold a key
+    create_key_name(1, 99, key_record.name);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &key_record).error);
+    KeystoreRamFV_getStatistics(&key_store, &snapshot);
+    ASSERT_EQ(1u, snapshot.calls[KeystoreRamFV_OP_GET]);
+    ASSERT_EQ(1u, snapshot.errors[KeystoreRamFV_OP_GET][not_found]);
+    ASSERT_EQ(4u, snapshot.slotsScanned);
+    ASSERT_EQ(0u, snapshot.bytesCopied);
+
+    // a hit compares at least its own name, whatever the scan kernel
+    KeystoreRamFV_resetStatistics(&key_store);
+    create_key_name(1, 3, key_record.name);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, 1, key_record.name, &key_record).error);
+    KeystoreRamFV_getStatistics(&key_store, &snapshot);
+    ASSERT_GE(snapshot.comparisons, 1u);
+    ASSERT_LE(snapshot.comparisons, 4u);
+
+    char names[2][KeystoreRamFV_KEY_NAME_SIZE];
+    unsigned int app_ids[2] = {1, 1};
+    KeystoreRamFV_Result_t results[2];
+    create_key_name(1, 0, names[0]);
+    create_key_name(1, 99, names[1]);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_deleteBatch(&key_store, 2, app_ids, names, results));
+    KeystoreRamFV_getStatistics(&key_store, &snapshot);
+    ASSERT_EQ(1u, snapshot.calls[KeystoreRamFV_OP_DELETE_BATCH]);
+    ASSERT_EQ(1u, snapshot.errors[KeystoreRamFV_OP_DELETE_BATCH][0]);
+    ASSERT_EQ(1u, snapshot.errors[KeystoreRamFV_OP_DELETE_BATCH][not_found]);
+
+    // a store without statistics counts nothing
+    KeyStore other_key_store;
+    KeystoreRamFV_init(&other_key_store, other_key_store.size(), other_key_store.get_element_buf());
+    KeystoreRamFV_getStatistics(&other_key_store, &snapshot);
+    ASSERT_EQ(0u, snapshot.calls[KeystoreRamFV_OP_INIT]);
+}
+#endif
+
+
+#if defined(KeystoreRamFV_TIMING)
+static unsigned long timing_clock;
+static unsigned long timing_step;
+
+// every call of the operation reads it twice, so each one takes timing_step
+static unsigned long step_timing_clock()
+{
+    timing_clock += timing_step;
+    return timing_clock;
+}
+
+// Expectation: the histograms report the latencies of each operation, the
+// percentiles to within 1/8 of their value.
+TEST(Test_KeystoreRamFV, latency_histograms_report_percentiles)
+{
+    KeyStore key_store;
+    std::unique_ptr<KeystoreRamFV_Timing_t> timing(new KeystoreRamFV_Timing_t());
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 1);
+    KeystoreRamFV_Latency_t latencies[KeystoreRamFV_NR_OPS];
+
+    timing->now = step_timing_clock;
+    config.timing = timing.get();
+
+    timing_step = 5;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+    timing_step = 7;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+    for (timing_step = 1; timing_step <= 1000; ++timing_step)
+    {
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, 1, key_record.name, &key_record).error);
+    }
+
+    KeystoreRamFV_getLatencies(&key_store, latencies);
+    ASSERT_EQ(1u, latencies[KeystoreRamFV_OP_INIT].count);
+    ASSERT_EQ(5u, latencies[KeystoreRamFV_OP_INIT].p50);
+    ASSERT_EQ(1u, latencies[KeystoreRamFV_OP_ADD].count);
+    ASSERT_EQ(7u, latencies[KeystoreRamFV_OP_ADD].p999);
+    ASSERT_EQ(0u, latencies[KeystoreRamFV_OP_DELETE].count);
+
+    KeystoreRamFV_Latency_t const &get = latencies[KeystoreRamFV_OP_GET];
+    ASSERT_EQ(1000u, get.count);
+    ASSERT_EQ(1000u, get.max);
+    ASSERT_GE(get.p50, 500u);
+    ASSERT_LE(get.p50, 500u + 500u / 8);
+    ASSERT_GE(get.p99, 990u);
+    ASSERT_LE(get.p99, 1000u);
+    ASSERT_GE(get.p999, 999u);
+    ASSERT_LE(get.p999, 1000u);
+
+    KeystoreRamFV_resetLatencies(&key_store);
+    KeystoreRamFV_getLatencies(&key_store, latencies);
+    ASSERT_EQ(0u, latencies[KeystoreRamFV_OP_GET].count);
+    ASSERT_EQ(0u, latencies[KeystoreRamFV_OP_GET].max);
+
+    // without a clock of its own, the store takes the monotonic clock
+    timing->now = NULL;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, 1, key_record.name, &key_record).error);
+    KeystoreRamFV_getLatencies(&key_store, latencies);
+    ASSERT_EQ(1u, latencies[KeystoreRamFV_OP_GET].count);
+    ASSERT_LE(latencies[KeystoreRamFV_OP_GET].p50, latencies[KeystoreRamFV_OP_GET].max);
+}
+#endif
+
+
+struct Snapshot
+{
+    std::vector<unsigned char> bytes;
+    unsigned long read_pos = 0;
+    unsigned long largest_piece = 0;
+
+    static unsigned int write(void *context, void const *bytes, unsigned long size)
+    {
+        Snapshot *snapshot = static_cast<Snapshot *>(context);
+        unsigned char const *p = static_cast<unsigned char const *>(bytes);
+
+        snapshot->bytes.insert(snapshot->bytes.end(), p, p + size);
+        snapshot->largest_piece = std::max(snapshot->largest_piece, size);
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    static unsigned int read(void *context, void *bytes, unsigned long size)
+    {
+        Snapshot *snapshot = static_cast<Snapshot *>(context);
+
+        if (snapshot->read_pos + size > snapshot->bytes.size())
+        {
+            return KeystoreRamFV_ERR_NOT_FOUND;
+        }
+
+        memcpy(bytes, &snapshot->bytes[snapshot->read_pos], size);
+        snapshot->read_pos += size;
+        return KeystoreRamFV_ERR_NONE;
+    }
+};
+
+
+// Expectation: an exported store holds only its keys and their data in use,
+// and importing it gives a store with the same keys, read only or not.
+TEST(Test_KeystoreRamFV, export_and_import_restore_the_keys)
+{
+    KeyStore key_store(64);
+    KeyStore restored_key_store(64);
+    KeystoreRamFV_Config_t config = key_store.get_config(false);
+    unsigned int read_only_app_id = 3;
+    KeystoreRamFV_KeyRecord_t read_only_key = init_key_record(read_only_app_id, 1000);
+    unsigned long expected_size = 16 + 4;
+
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+              KeystoreRamFV_initWithConfig(&key_store, &config, &read_only_app_id, &read_only_key, 1));
+    expected_size += 6 + KeystoreRamFV_KEY_NAME_SIZE + KeystoreRamFV_KEY_DATA_SIZE;
+
+    for (unsigned int k = 0; k < 40; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_addWithSize(&key_store, k % 5, &key_record, k * 7).error);
+    }
+    // the deleted keys leave free elements between the others
+    for (unsigned int k = 0; k < 40; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        if (k % 3 == 0)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, k % 5, key_record.name));
+        }
+        else
+        {
+            expected_size += 6 + KeystoreRamFV_KEY_NAME_SIZE + k * 7;
+        }
+    }
+
+    Snapshot snapshot;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_export(&key_store, Snapshot::write, &snapshot));
+    ASSERT_EQ(expected_size, snapshot.bytes.size());
+    ASSERT_LE(snapshot.largest_piece, (unsigned long) KeystoreRamFV_KEY_DATA_SIZE);
+
+    KeystoreRamFV_Config_t restored_config = restored_key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+              KeystoreRamFV_import(&restored_key_store, &restored_config, Snapshot::read, &snapshot));
+    ASSERT_EQ(snapshot.bytes.size(), snapshot.read_pos);
+
+    for (unsigned int k = 0; k < 40; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        KeystoreRamFV_KeyRecord_t found_key;
+        unsigned long data_size = 0;
+        KeystoreRamFV_Result_t result =
+            KeystoreRamFV_getWithSize(&restored_key_store, k % 5, key_record.name, &found_key, &data_size);
+
+        if (k % 3 == 0)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, result.error);
+            continue;
+        }
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(k * 7, data_size);
+        ASSERT_EQ(0, memcmp(key_record.data, found_key.data, data_size));
+        ASSERT_EQ(0u, found_key.readOnly);
+    }
+
+    KeystoreRamFV_KeyRecord_t found_key;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+              KeystoreRamFV_get(&restored_key_store, read_only_app_id, read_only_key.name, &found_key).error);
+    ASSERT_EQ(0, compare_key_records(read_only_key, found_key));
+    ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, KeystoreRamFV_delete(&restored_key_store, read_only_app_id, read_only_key.name));
+
+    // the restored store takes as many keys as the original one
+    unsigned int added = 0;
+    for (unsigned int k = 100; KeystoreRamFV_ERR_NONE == KeystoreRamFV_add(&restored_key_store, 4, &found_key).error; ++k)
+    {
+        create_key_name(4, k, found_key.name);
+        added++;
+    }
+    ASSERT_EQ(64u - 1 - 26, added);
+}
+
+
+// Expectation: an import of a damaged snapshot fails and leaves the store empty.
+TEST(Test_KeystoreRamFV, import_rejects_damaged_snapshots)
+{
+    KeyStore key_store;
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 1);
+    Snapshot snapshot;
+
+    KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0);
+    for (unsigned int k = 0; k < 4; ++k)
+    {
+        key_record = init_key_record(1, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+    }
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_export(&key_store, Snapshot::write, &snapshot));
+
+    struct Damage
+    {
+        unsigned long offset;   /* of the byte to change */
+        unsigned char value;
+        unsigned long truncate; /* to this size, if not 0 */
+        unsigned int error;
+    };
+    Damage const damages[] = {
+        {0, 'X', 0, KeystoreRamFV_ERR_INVALID_PARAMETER},              // magic
+        {4, 2, 0, KeystoreRamFV_ERR_INVALID_PARAMETER},                // version
+        {12, 17, 0, KeystoreRamFV_ERR_OUT_OF_SPACE},                   // number of keys
+        {16, 2, 0, KeystoreRamFV_ERR_GENERIC},                         // app id
+        {16 + 6 + KeystoreRamFV_KEY_NAME_SIZE + 5, 0x55, 0, KeystoreRamFV_ERR_GENERIC}, // data
+        {0, 0, 100, KeystoreRamFV_ERR_NOT_FOUND},                      // by the reader
+    };
+
+    for (Damage const &damage : damages)
+    {
+        Snapshot damaged;
+        damaged.bytes = snapshot.bytes;
+        if (damage.truncate > 0)
+        {
+            damaged.bytes.resize(damage.truncate);
+        }
+        else
+        {
+            damaged.bytes[damage.offset] = damage.value;
+        }
+
+        ASSERT_EQ(damage.error, KeystoreRamFV_import(&key_store, &config, Snapshot::read, &damaged));
+
+        for (unsigned int k = 0; k < 4; ++k)
+        {
+            key_record = init_key_record(1, k);
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &key_record).error);
+        }
+    }
+
+    // the name of the second key made the same as the one of the first
+    Snapshot duplicated;
+    duplicated.bytes = snapshot.bytes;
+    unsigned long second_key = 16 + 6 + KeystoreRamFV_KEY_NAME_SIZE + KeystoreRamFV_KEY_DATA_SIZE;
+    memcpy(&duplicated.bytes[second_key + 6], &snapshot.bytes[16 + 6], KeystoreRamFV_KEY_NAME_SIZE);
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_import(&key_store, &config, Snapshot::read, &duplicated));
+
+    // a smaller store cannot take all keys
+    KeyStore small_key_store(3);
+    KeystoreRamFV_Config_t small_config = small_key_store.get_config();
+    snapshot.read_pos = 0;
+    ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, KeystoreRamFV_import(&small_key_store, &small_config, Snapshot::read, &snapshot));
+}
+
+
+// Expectation: a store opened again from its file still has the keys it had
+// when it was closed, takes as many new keys as before, and a file of another
+// geometry is refused.
+TEST(Test_KeystoreRamFV, file_backed_key_store_survives_a_restart)
+{
+    char path[] = "/tmp/KeystoreRamFVTest.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_LE(0, fd);
+    close(fd);
+
+    KeyStore key_store(64);
+    KeystoreRamFVFile_Config_t config = {};
+    config.path = path;
+    config.config = key_store.get_config();
+    config.syncGranularity = 4;
+
+    KeystoreRamFVFile_t file;
+    unsigned int attached = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(0u, attached);
+
+    for (unsigned int k = 0; k < 40; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_addWithSize(&file, k % 5, &key_record, k + 1).error);
+    }
+    for (unsigned int k = 0; k < 40; k += 3)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_delete(&file, k % 5, key_record.name));
+    }
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+
+    // the index lives in memory only and is rebuilt on attaching
+    KeyStore restarted_key_store(64);
+    config.config = restarted_key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(1u, attached);
+
+    for (unsigned int k = 0; k < 40; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        KeystoreRamFV_KeyRecord_t found_key;
+        unsigned long data_size = 0;
+        KeystoreRamFV_Result_t result =
+            KeystoreRamFV_getWithSize(&file.keyStore, k % 5, key_record.name, &found_key, &data_size);
+
+        if (k % 3 == 0)
+        {
+            ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, result.error);
+            continue;
+        }
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(k + 1, data_size);
+        ASSERT_EQ(0, memcmp(key_record.data, found_key.data, data_size));
+    }
+
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 1);
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFVFile_add(&file, 1, &key_record).error);
+
+    unsigned int added = 0;
+    for (unsigned int k = 100; ; ++k)
+    {
+        key_record = init_key_record(4, k);
+        if (KeystoreRamFV_ERR_NONE != KeystoreRamFVFile_add(&file, 4, &key_record).error)
+        {
+            break;
+        }
+        added++;
+    }
+    ASSERT_EQ(64u - 26, added);
+
+    // the wiped keys do not come back, the new epoch is in the file at once
+    // even if nothing else is synced before a crash
+    file.syncGranularity = 0;
+    KeystoreRamFVFile_wipeDeferred(&file);
+    ASSERT_EQ(file.keyStore.epoch, ((KeystoreRamFVFile_Header_t *) file.mapping)->epoch);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(1u, attached);
+    ASSERT_EQ(64ul, file.keyStore.freeSlots);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&file.keyStore, 4, key_record.name, &key_record).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+
+    KeyStore small_key_store(32);
+    config.config = small_key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVFile_open(&file, &config, &attached));
+
+    // elements of another layout, with a header that is valid otherwise
+    config.config = restarted_key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ((KeystoreRamFVFile_Header_t *) file.mapping)->layoutVersion = KeystoreRamFV_LAYOUT_VERSION - 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVFile_open(&file, &config, &attached));
+
+    unlink(path);
+}
+
+
+
+// Expectation: a file whose creation was interrupted before its header was
+// written is created again, and one whose store cannot be initialized is left
+// empty, so neither is refused from then on.
+TEST(Test_KeystoreRamFV, file_backed_key_store_recovers_from_an_interrupted_creation)
+{
+    char path[] = "/tmp/KeystoreRamFVTest.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_LE(0, fd);
+
+    KeyStore key_store(16);
+    KeystoreRamFVFile_Config_t config = {};
+    config.path = path;
+    config.config = key_store.get_config();
+
+    // elements partly written, but no header
+    std::vector<char> bytes(KeystoreRamFVFile_ELEMENTS_OFFSET +
+                            16 * sizeof(KeystoreRamFV_ElementRecord_t), 0);
+    bytes[KeystoreRamFVFile_ELEMENTS_OFFSET + 5] = 1;
+    ASSERT_EQ((ssize_t) bytes.size(), write(fd, &bytes[0], bytes.size()));
+    close(fd);
+
+    KeystoreRamFVFile_t file;
+    unsigned int attached = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(0u, attached);
+    ASSERT_EQ(16ul, file.keyStore.freeSlots);
+
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 1);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_add(&file, 1, &key_record).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(1u, attached);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+
+    // an index too small for the store
+    ASSERT_EQ(0, truncate(path, 0));
+    config.config.indexSize = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVFile_open(&file, &config, &attached));
+
+    struct stat file_stat;
+    ASSERT_EQ(0, stat(path, &file_stat));
+    ASSERT_EQ(0, file_stat.st_size);
+
+    config.config = key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_open(&file, &config, &attached));
+    ASSERT_EQ(0u, attached);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVFile_close(&file));
+
+    unlink(path);
+}
+
+// Expectation: attaching elements zeroes the bytes no key uses and refuses
+// elements that hold the same key twice.
+TEST(Test_KeystoreRamFV, attach_clears_unused_bytes_and_detects_duplicates)
+{
+    // the elements below are of the layout the library expects
+    ASSERT_EQ((unsigned long) KeystoreRamFV_LAYOUT_VERSION, KeystoreRamFV_getLayoutVersion());
+
+    KeyStore key_store(16);
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    for (unsigned int k = 0; k < 8; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 3, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_addWithSize(&key_store, k % 3, &key_record, 4).error);
+    }
+
+    // left over in the memory of a key and of a free element
+    KeystoreRamFV_ElementRecord_t *elements = key_store.get_element_buf();
+    elements[2].key.data[10] = 1;
+    elements[12].key.name[3] = 1;
+    elements[12].key.data[0] = 1;
+
+    KeyStore attached_key_store(16);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_attach(&attached_key_store, &config, 0));
+    ASSERT_EQ(8ul, (&attached_key_store)->freeSlots);
+    ASSERT_EQ(0, elements[2].key.data[10]);
+    ASSERT_EQ(0, elements[12].key.name[3]);
+    ASSERT_EQ(0, elements[12].key.data[0]);
+
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(2, 2);
+    KeystoreRamFV_KeyRecord_t found_key;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&attached_key_store, 2, key_record.name, &found_key).error);
+    ASSERT_EQ(0, memcmp(key_record.data, found_key.data, 4));
+
+    // the name of the sixth key made the same as the one of the third, which
+    // leaves the elements untouched, with an index and without
+    memcpy(elements[5].key.name, elements[2].key.name, KeystoreRamFV_KEY_NAME_SIZE);
+    elements[5].admin.appId = elements[2].admin.appId;
+    elements[3].key.data[10] = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_attach(&attached_key_store, &config, 0));
+    ASSERT_EQ(1, elements[3].key.data[10]);
+
+    KeystoreRamFV_Config_t plain_config = config;
+    plain_config.indexSize = 0;
+    plain_config.indexStore = NULL;
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_attach(&attached_key_store, &plain_config, 0));
+    ASSERT_EQ(1, elements[3].key.data[10]);
+
+    // not even stale elements are scrubbed
+    elements[7].admin.epoch = 1;
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFV_attach(&attached_key_store, &plain_config, 0));
+    ASSERT_EQ(0u, elements[7].admin.isFree);
+}
+
+typedef std::map<std::string, unsigned long> Indices;
+
+static std::string
+name_of(const char name[KeystoreRamFV_KEY_NAME_SIZE])
+{
+    return std::string(name, strnlen(name, KeystoreRamFV_KEY_NAME_SIZE));
+}
+
+
+static void
+record_relocation(
+    void *context,
+    unsigned int app_id,
+    const char name[KeystoreRamFV_KEY_NAME_SIZE],
+    unsigned long from,
+    unsigned long to)
+{
+    Indices *indices = static_cast<Indices *>(context);
+
+    // the names start with the app id
+    ASSERT_EQ(app_id, std::stoul(name_of(name).substr(0, 4), nullptr, 16));
+    ASSERT_EQ(from, (*indices)[name_of(name)]);
+    (*indices)[name_of(name)] = to;
+}
+
+
+// Expectation: compaction moves the keys down into the free elements in
+// bounded steps, reports where each went and lowers the high water mark to the
+// number of keys, with or without free map and index.
+TEST(Test_KeystoreRamFV, compaction_packs_keys_toward_the_front)
+{
+    for (bool accelerated : {false, true})
+    {
+        KeyStore key_store(64);
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        unsigned int read_only_app_id = 3;
+        KeystoreRamFV_KeyRecord_t read_only_key = init_key_record(read_only_app_id, 1000);
+        std::vector<unsigned int> kept;
+        Indices indices;
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                  KeystoreRamFV_initWithConfig(&key_store, &config, &read_only_app_id, &read_only_key, 1));
+
+        for (unsigned int k = 0; k < 63; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+            KeystoreRamFV_Result_t result = KeystoreRamFV_addWithSize(&key_store, k % 5, &key_record, k);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+
+            if (k % 4 == 3)
+            {
+                kept.push_back(k);
+                indices[name_of(key_record.name)] = result.index;
+            }
+        }
+        for (unsigned int k = 0; k < 63; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+            if (k % 4 != 3)
+            {
+                ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, k % 5, key_record.name));
+            }
+        }
+
+        unsigned long steps = 0;
+        while (KeystoreRamFV_compact(&key_store, 4, record_relocation, &indices) > 0)
+        {
+            steps++;
+        }
+        ASSERT_LT(1ul, steps);
+        ASSERT_EQ(0ul, KeystoreRamFV_compact(&key_store, 4, record_relocation, &indices));
+        ASSERT_EQ(1 + kept.size(), (&key_store)->highWater);
+
+        for (unsigned int j = 0; j < kept.size(); ++j)
+        {
+            unsigned int k = kept[j];
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+            KeystoreRamFV_KeyRecord_t found_key;
+            unsigned long data_size = 0;
+            unsigned long index = indices[name_of(key_record.name)];
+
+            ASSERT_GT((&key_store)->highWater, index);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                      KeystoreRamFV_getByIndexWithSize(&key_store, k % 5, index, &found_key, &data_size));
+            ASSERT_EQ(k, data_size);
+            ASSERT_EQ(0, memcmp(key_record.name, found_key.name, KeystoreRamFV_KEY_NAME_SIZE));
+            ASSERT_EQ(0, memcmp(key_record.data, found_key.data, data_size));
+            ASSERT_EQ(index, KeystoreRamFV_get(&key_store, k % 5, key_record.name, &found_key).index);
+        }
+
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(0ul,
+                  KeystoreRamFV_get(&key_store, read_only_app_id, read_only_key.name, &found_key).index);
+
+        // the vacated elements are zero and can be taken again
+        KeystoreRamFV_ElementRecord_t const *elements = key_store.get_element_buf();
+        for (unsigned long k = (&key_store)->highWater; k < 64; ++k)
+        {
+            ASSERT_EQ(0, elements[k].key.name[0]);
+        }
+
+        unsigned int added = 0;
+        for (unsigned int k = 100; ; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(4, k);
+            if (KeystoreRamFV_ERR_NONE != KeystoreRamFV_add(&key_store, 4, &key_record).error)
+            {
+                break;
+            }
+            added++;
+        }
+        ASSERT_EQ(64u - 1 - kept.size(), added);
+    }
+}
+
+
+// Hands out the memory of up to max_chunks chunks, one KeyStore each.
+struct ChunkAllocator
+{
+    std::vector<std::unique_ptr<KeyStore>> chunks;
+    unsigned long max_chunks;
+    unsigned long given_back = 0;
+    unsigned long wrong_size = 0; /* of the chunks given from then on */
+
+    static unsigned int grow(void *context, unsigned long chunk, KeystoreRamFV_Config_t *config)
+    {
+        ChunkAllocator *allocator = static_cast<ChunkAllocator *>(context);
+
+        if (chunk >= allocator->max_chunks)
+        {
+            return KeystoreRamFV_ERR_OUT_OF_SPACE;
+        }
+
+        allocator->chunks.resize(chunk + 1);
+        allocator->chunks[chunk].reset(new KeyStore(config->maxElements));
+        *config = allocator->chunks[chunk]->get_config();
+        config->lazyInit = 1;
+        if (allocator->wrong_size > 0)
+        {
+            config->maxElements = allocator->wrong_size;
+        }
+        return KeystoreRamFV_ERR_NONE;
+    }
+
+    static void shrink(void *context, unsigned long chunk, KeystoreRamFV_Config_t const *config)
+    {
+        ChunkAllocator *allocator = static_cast<ChunkAllocator *>(context);
+
+        // the configuration grow() filled in
+        ASSERT_EQ(allocator->chunks[chunk]->get_element_buf(), config->elementStore);
+        allocator->chunks[chunk].reset();
+        allocator->given_back++;
+    }
+};
+
+
+// Expectation: a growable store asks for a chunk whenever it is full, keeps
+// the indices of its keys when growing and shrinking, and gives back empty
+// chunks at its end.
+TEST(Test_KeystoreRamFV, growable_key_store_grows_and_shrinks_in_chunks)
+{
+    ChunkAllocator allocator;
+    allocator.max_chunks = 3;
+    KeystoreRamFVGrowable_Chunk_t chunks[4];
+    KeystoreRamFVGrowable_Config_t config = {};
+    config.chunks = chunks;
+    config.maxChunks = 4;
+    config.chunkElements = 16;
+    config.grow = ChunkAllocator::grow;
+    config.shrink = ChunkAllocator::shrink;
+    config.context = &allocator;
+
+    KeystoreRamFVGrowable_t key_store;
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVGrowable_init(&key_store, &config));
+    ASSERT_EQ(0ul, key_store.nrChunks);
+
+    // illegal arguments are caught also without any chunk
+    KeystoreRamFV_KeyRecord_t illegal_key = init_key_record(1, 1);
+    unsigned long illegal_size = 0;
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_get(&key_store, 1, NULL, &illegal_key).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_get(&key_store, 1, illegal_key.name, NULL).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER,
+              KeystoreRamFVGrowable_getWithSize(&key_store, KeystoreRamFV_MAX_APP_ID + 1, illegal_key.name, &illegal_key, &illegal_size).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_delete(&key_store, 1, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_delete(&key_store, KeystoreRamFV_MAX_APP_ID + 1, illegal_key.name));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_getByIndex(&key_store, 1, 0, NULL));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_getByIndex(&key_store, KeystoreRamFV_MAX_APP_ID + 1, 0, &illegal_key));
+
+    std::vector<unsigned long> indices;
+    for (unsigned int k = 0; k < 48; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        KeystoreRamFV_Result_t result = KeystoreRamFVGrowable_addWithSize(&key_store, k % 5, &key_record, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        ASSERT_EQ(k / 16 + 1, key_store.nrChunks);
+        indices.push_back(result.index);
+    }
+
+    // the allocator has no memory for a fourth chunk
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 100);
+    ASSERT_EQ(KeystoreRamFV_ERR_OUT_OF_SPACE, KeystoreRamFVGrowable_add(&key_store, 1, &key_record).error);
+    key_record = init_key_record(2, 47);
+    ASSERT_EQ(KeystoreRamFV_ERR_DUPLICATED, KeystoreRamFVGrowable_add(&key_store, 2, &key_record).error);
+
+    // emptying the middle chunk gives nothing back, emptying the last one does
+    for (unsigned int k = 16; k < 48; ++k)
+    {
+        key_record = init_key_record(k % 5, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVGrowable_delete(&key_store, k % 5, key_record.name));
+        if (k == 31)
+        {
+            ASSERT_EQ(0ul, KeystoreRamFVGrowable_shrink(&key_store));
+        }
+    }
+    ASSERT_EQ(2ul, KeystoreRamFVGrowable_shrink(&key_store));
+    ASSERT_EQ(1ul, key_store.nrChunks);
+    ASSERT_EQ(2ul, allocator.given_back);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND,
+              KeystoreRamFVGrowable_getByIndex(&key_store, 47 % 5, indices[47], &key_record));
+
+    for (unsigned int k = 0; k < 16; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t expected_key = init_key_record(k % 5, k);
+        unsigned long data_size = 0;
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                  KeystoreRamFVGrowable_getByIndexWithSize(&key_store, k % 5, indices[k], &key_record, &data_size));
+        ASSERT_EQ(k, data_size);
+        ASSERT_EQ(0, memcmp(expected_key.data, key_record.data, data_size));
+        ASSERT_EQ(indices[k], KeystoreRamFVGrowable_get(&key_store, k % 5, expected_key.name, &key_record).index);
+    }
+
+    // and it grows again
+    key_record = init_key_record(1, 100);
+    KeystoreRamFV_Result_t result = KeystoreRamFVGrowable_add(&key_store, 1, &key_record);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+    ASSERT_EQ(16ul, result.index);
+    ASSERT_EQ(2ul, key_store.nrChunks);
+    ASSERT_EQ(15ul, KeystoreRamFVGrowable_getFreeSlots(&key_store));
+
+    // a chunk of the wrong size is refused and given back
+    for (unsigned int k = 101; k < 116; ++k)
+    {
+        key_record = init_key_record(1, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFVGrowable_add(&key_store, 1, &key_record).error);
+    }
+    allocator.wrong_size = 8;
+    key_record = init_key_record(1, 116);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFVGrowable_add(&key_store, 1, &key_record).error);
+    ASSERT_EQ(2ul, key_store.nrChunks);
+    ASSERT_EQ(3ul, allocator.given_back);
+    ASSERT_EQ(nullptr, allocator.chunks[2].get());
+}
+
+
+// Expectation: adapting moves the keys looked up most toward the front, one
+// read only key stays in place, and keys of equal use are left where they are.
+TEST(Test_KeystoreRamFV, adapting_moves_hot_keys_to_the_front)
+{
+    KeyStore key_store(64);
+    KeystoreRamFV_Config_t config = key_store.get_config(false);
+    std::vector<unsigned int> hit_counters(KeystoreRamFV_HIT_COUNTERS_SIZE(64));
+    unsigned int read_only_app_id = 3;
+    KeystoreRamFV_KeyRecord_t read_only_key = init_key_record(read_only_app_id, 1000);
+    Indices indices;
+
+    config.hitCounters = &hit_counters[0];
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+              KeystoreRamFV_initWithConfig(&key_store, &config, &read_only_app_id, &read_only_key, 1));
+    ASSERT_EQ(0ul, KeystoreRamFV_adapt(&key_store, 2, record_relocation, &indices));
+
+    for (unsigned int k = 0; k < 60; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        KeystoreRamFV_Result_t result = KeystoreRamFV_addWithSize(&key_store, k % 5, &key_record, k);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, result.error);
+        indices[name_of(key_record.name)] = result.index;
+    }
+
+    // every key is looked up once, the hot ones many times more
+    unsigned int const hot_keys[] = {50, 57, 41};
+    for (unsigned int round = 0; round < 8; ++round)
+    {
+        KeystoreRamFV_KeyRecord_t found_key;
+        KeystoreRamFV_KeyView_t view;
+
+        for (unsigned int k = 0; k < 60; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, k % 5, key_record.name, &found_key).error);
+        }
+        for (unsigned int h = 0; h < 3; ++h)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(hot_keys[h] % 5, hot_keys[h]);
+            for (unsigned int l = 0; l < 30 - 10 * h; ++l)
+            {
+                KeystoreRamFV_borrow(&key_store, hot_keys[h] % 5, key_record.name, &view);
+            }
+        }
+
+        KeystoreRamFV_adapt(&key_store, 2, record_relocation, &indices);
+    }
+
+    ASSERT_EQ(0ul, KeystoreRamFV_get(&key_store, read_only_app_id, read_only_key.name, &read_only_key).index);
+    for (unsigned int h = 0; h < 3; ++h)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(hot_keys[h] % 5, hot_keys[h]);
+        KeystoreRamFV_KeyRecord_t found_key;
+        unsigned long data_size = 0;
+
+        ASSERT_EQ(1ul + h, KeystoreRamFV_get(&key_store, hot_keys[h] % 5, key_record.name, &found_key).index);
+        ASSERT_EQ(1ul + h, indices[name_of(key_record.name)]);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                  KeystoreRamFV_getByIndexWithSize(&key_store, hot_keys[h] % 5, 1 + h, &found_key, &data_size));
+        ASSERT_EQ(hot_keys[h], data_size);
+        ASSERT_EQ(0, memcmp(key_record.data, found_key.data, data_size));
+    }
+
+    // the counters age, with no more lookups nothing moves
+    for (unsigned int round = 0; round < 8; ++round)
+    {
+        KeystoreRamFV_adapt(&key_store, 2, record_relocation, &indices);
+    }
+    ASSERT_EQ(0ul, KeystoreRamFV_adapt(&key_store, 2, record_relocation, &indices));
+
+    for (unsigned int k = 0; k < 60; ++k)
+    {
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 5, k);
+        KeystoreRamFV_KeyRecord_t found_key;
+        ASSERT_EQ(indices[name_of(key_record.name)],
+                  KeystoreRamFV_get(&key_store, k % 5, key_record.name, &found_key).index);
+        ASSERT_EQ(0, memcmp(key_record.data, found_key.data, k));
+    }
+}
+
+
+// Expectation: the lookup cache answers repeated lookups, counting hits and
+// misses, and never returns an element that no longer holds the key, after
+// deletes, reuse of the element, wipes and re-initialization.
+TEST(Test_KeystoreRamFV, lookup_cache_never_returns_another_key)
+{
+    for (bool accelerated : {false, true})
+    {
+        KeyStore key_store(32);
+        KeystoreRamFV_Config_t config = key_store.get_config(accelerated);
+        std::vector<KeystoreRamFV_CacheEntry_t> entries(2 * KeystoreRamFV_CACHE_WAYS);
+        KeystoreRamFV_LookupCache_t cache = {2, &entries[0], 0, 0};
+        KeystoreRamFV_KeyRecord_t found_key;
+
+        config.lookupCache = &cache;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+        for (unsigned int k = 0; k < 20; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t key_record = init_key_record(k % 3, k);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, k % 3, &key_record).error);
+        }
+
+        KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 7);
+        for (unsigned int l = 0; l < 5; ++l)
+        {
+            ASSERT_EQ(7ul, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).index);
+            ASSERT_EQ(0, compare_key_records(key_record, found_key));
+        }
+        ASSERT_EQ(4ul, cache.hits);
+        ASSERT_EQ(1ul, cache.misses);
+
+        // the app id is part of the key
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 2, key_record.name, &found_key).error);
+
+        // the element of the deleted key is taken by another one
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_delete(&key_store, 1, key_record.name));
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+        KeystoreRamFV_KeyRecord_t other_key = init_key_record(1, 100);
+        ASSERT_EQ(7ul, KeystoreRamFV_add(&key_store, 1, &other_key).index);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+        ASSERT_EQ(20ul, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).index);
+        ASSERT_EQ(20ul, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).index);
+
+        // more keys than entries still are all found
+        for (unsigned int k = 0; k < 20; ++k)
+        {
+            KeystoreRamFV_KeyRecord_t expected_key = init_key_record(k % 3, k);
+            ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, k % 3, expected_key.name, &found_key).error);
+            ASSERT_EQ(0, compare_key_records(expected_key, found_key));
+        }
+
+        KeystoreRamFV_wipeDeferred(&key_store);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+        KeystoreRamFV_wipe(&key_store);
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_add(&key_store, 1, &key_record).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+        config.lazyInit = 1;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+        for (KeystoreRamFV_CacheEntry_t const &entry : entries)
+        {
+            ASSERT_EQ(0ul, entry.element);
+        }
+        ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_get(&key_store, 1, key_record.name, &found_key).error);
+    }
+}
+
+
+// Expectation: find locates keys without counting hits, and deleting by the
+// index it gives checks the index like getByIndex does.
+TEST(Test_KeystoreRamFV, find_has_no_side_effects_and_delete_by_index_deletes)
+{
+    KeyStore key_store;
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    std::vector<unsigned int> hit_counters(KeystoreRamFV_HIT_COUNTERS_SIZE(key_store.size()));
+    unsigned int read_only_app_id = 3;
+    KeystoreRamFV_KeyRecord_t read_only_key = init_key_record(read_only_app_id, 100);
+
+    config.hitCounters = &hit_counters[0];
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+              KeystoreRamFV_initWithConfig(&key_store, &config, &read_only_app_id, &read_only_key, 1));
+
+    KeystoreRamFV_KeyRecord_t key_record = init_key_record(1, 0);
+    ASSERT_EQ(1ul, KeystoreRamFV_add(&key_store, 1, &key_record).index);
+
+    KeystoreRamFV_Result_t found = KeystoreRamFV_find(&key_store, 1, key_record.name);
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, found.error);
+    ASSERT_EQ(1ul, found.index);
+    ASSERT_EQ(0u, hit_counters[1]);
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_find(&key_store, 2, key_record.name).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_find(&key_store, KeystoreRamFV_MAX_APP_ID + 1, key_record.name).error);
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_find(&key_store, 1, NULL).error);
+
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_deleteByIndex(&key_store, 2, found.index));
+    ASSERT_EQ(KeystoreRamFV_ERR_INVALID_PARAMETER, KeystoreRamFV_deleteByIndex(&key_store, 1, key_store.size()));
+    ASSERT_EQ(KeystoreRamFV_ERR_READ_ONLY, KeystoreRamFV_deleteByIndex(&key_store, read_only_app_id, 0));
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_deleteByIndex(&key_store, 1, found.index));
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_deleteByIndex(&key_store, 1, found.index));
+    ASSERT_EQ(KeystoreRamFV_ERR_NOT_FOUND, KeystoreRamFV_find(&key_store, 1, key_record.name).error);
+}
+
+
+// Expectation: looking up keys of the read only segment counts no hit, so the
+// memory after the hit counters is left alone.
+TEST(Test_KeystoreRamFV, segment_keys_count_no_hits)
+{
+    KeyStore key_store;
+    KeystoreRamFV_Config_t config = key_store.get_config();
+    const unsigned long nr_segment_keys = sizeof(segment_keys) / sizeof(segment_keys[0]);
+    // followed by guards as many as the segment has keys
+    std::vector<unsigned int> hit_counters(KeystoreRamFV_HIT_COUNTERS_SIZE(key_store.size()) + 1 + nr_segment_keys, 7);
+
+    config.hitCounters = &hit_counters[0];
+    config.readOnlySegment = segment.get();
+    ASSERT_EQ(KeystoreRamFV_ERR_NONE, KeystoreRamFV_initWithConfig(&key_store, &config, NULL, NULL, 0));
+
+    for (unsigned long l = 0; l < nr_segment_keys; ++l)
+    {
+        KeystoreRamFV_KeyRecord_t found_key;
+        unsigned long data_size = 0;
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                  KeystoreRamFV_get(&key_store, segment_keys[l].appId, segment_keys[l].key.name, &found_key).error);
+        ASSERT_EQ(KeystoreRamFV_ERR_NONE,
+                  KeystoreRamFV_getWithSize(&key_store, segment_keys[l].appId, segment_keys[l].key.name, &found_key, &data_size).error);
+    }
+
+    for (unsigned long l = key_store.size(); l < hit_counters.size(); ++l)
+    {
+        ASSERT_EQ(7u, hit_counters[l]);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     testing::InitGoogleTest(&argc, argv);
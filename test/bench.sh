@@ -0,0 +1,16 @@
+# builds the benchmark once per scan kernel of KeystoreRamFV.c and runs it,
+# writing the results to bench_<kernel>.json; arguments go to the benchmark
+gcc -c -O2 -I../stdlib_fv ../stdlib_fv/stdlib_fv.c
+gcc -c -O2 -std=c11 ../KeystoreRamFVConcurrent.c ../KeystoreRamFVSharded.c
+for kernel in scalar sse2 avx2
+do
+    case $kernel in
+        scalar) FLAGS=-DKeystoreRamFV_SCAN_SCALAR ;;
+        sse2)   FLAGS= ;;
+        avx2)   FLAGS=-mavx2 ;;
+    esac
+    gcc -c -O2 $FLAGS -I../stdlib_fv ../KeystoreRamFV.c -o KeystoreRamFV_$kernel.o
+    g++ -c -O2 -std=c++20 -DKeystoreRamFV_BENCH_KERNEL=\"$kernel\" KeystoreRamFVBench.cpp -o KeystoreRamFVBench_$kernel.o
+    g++ -pthread -o bench_$kernel KeystoreRamFV_$kernel.o KeystoreRamFVConcurrent.o KeystoreRamFVSharded.o KeystoreRamFVBench_$kernel.o stdlib_fv.o
+    ./bench_$kernel "$@" > bench_$kernel.json
+done
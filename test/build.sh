@@ -1,7 +1,13 @@
 rm test
 rm *.o
-gcc -c -I../googletest/googletest/include KeystoreRamFVTest.cpp
-gcc -c -I../googletest/googletest/include -I../stdlib_fv ../KeystoreRamFV.c
+# the tests cover the statistics and the timing, see KeystoreRamFV.h
+FLAGS="-DKeystoreRamFV_STATISTICS -DKeystoreRamFV_TIMING"
+gcc -c $FLAGS -std=c++20 -I../googletest/googletest/include KeystoreRamFVTest.cpp
+gcc -c $FLAGS -I../googletest/googletest/include -I../stdlib_fv ../KeystoreRamFV.c
+gcc -c $FLAGS -std=c11 ../KeystoreRamFVConcurrent.c
+gcc -c $FLAGS -std=c11 -I../stdlib_fv ../KeystoreRamFVSharded.c
+gcc -c $FLAGS -std=c11 -I../stdlib_fv ../KeystoreRamFVFile.c
+gcc -c $FLAGS -std=c11 -I../stdlib_fv ../KeystoreRamFVGrowable.c
 gcc -c -I../stdlib_fv ../stdlib_fv/stdlib_fv.c
-g++ -o test KeystoreRamFV.o KeystoreRamFVTest.o stdlib_fv.o -Wl,-L/home/a/tmp/googletest/googletest/build/lib -Wl,-lgtest -Wl,-lpthread
+g++ -o test KeystoreRamFV.o KeystoreRamFVConcurrent.o KeystoreRamFVSharded.o KeystoreRamFVFile.o KeystoreRamFVGrowable.o KeystoreRamFVTest.o stdlib_fv.o -Wl,-L/home/a/tmp/googletest/googletest/build/lib -Wl,-lgtest -Wl,-lpthread
 ./test